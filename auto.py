@@ -1,4 +1,6 @@
-import subprocess, re, os, shutil
+import subprocess, os, shutil, json, tempfile, hashlib, glob, re, threading, math
+from concurrent.futures import ThreadPoolExecutor
+from queue import Queue
 import pandas as pd
 import matplotlib.pyplot as plt
 import time 
@@ -9,64 +11,362 @@ NOME_PROGRAMA_PART2 = "lab2-part2"
 COMANDO_NS3 = "./ns3"
 DIR_SAIDA = "Lab2_Sobrenome_Nome/Part1"
 DIR_SCRATCH = "scratch"
-ARQ_TRACE_FIXO = "Congestion_Control-cwnd.data"
+ARQ_TRACE_FIXO = "Congestion_Control-tcp.data"
 CAMINHO_TRACE_FIXO_1 = os.path.join(DIR_SCRATCH, "resultados", ARQ_TRACE_FIXO)
+# Nas varreduras o trace sai agregado em baldes de 10 ms (min/max/ultimo),
+# ordens de grandeza menor que um registro por ACK. Use traceMode=full para o
+# trace completo.
+PARAMS_TRACE = {'traceMode': 'bucket', 'traceBucket': '10ms'}
+# Pontos independentes rodam em paralelo, um processo por núcleo. Cada execução
+# escreve num diretório próprio (outputPrefix) e os resultados voltam na ordem
+# em que foram pedidos, iguais aos da execução serial (LAB2_WORKERS=1).
+N_WORKERS = int(os.environ.get("LAB2_WORKERS", len(os.sched_getaffinity(0))))
+# Com LAB2_TOLERANCIA (ex.: 0.05) cada ponto para quando o IC de 95% do goodput
+# por fluxo (médias de lotes, sem o warm-up) fica dentro dessa fração da média,
+# com a duração normal como teto. Sem ela, todos os pontos simulam 20 s.
+PARAMS_CONVERGENCIA = ({'convergeTolerance': os.environ["LAB2_TOLERANCIA"]}
+                       if os.environ.get("LAB2_TOLERANCIA") else {})
+# Com LAB2_FORK_AT (ex.: 5s) a parte 1c simula cada protocolo e nº de fluxos
+# uma vez até esse instante, com a menor taxa de erro, e então bifurca um
+# processo por taxa restante (forkAt), que segue dali com a sua taxa. O
+# aquecimento é simulado uma vez só, mas cada taxa só vale a partir de
+# LAB2_FORK_AT.
+FORK_AT = os.environ.get("LAB2_FORK_AT")
+# Com LAB2_ADAPTATIVO (ex.: 0.1) as partes 1b e 1c partem de uma grade grossa
+# e só acrescentam pontos onde a curva muda: o intervalo entre dois pontos
+# vizinhos é dividido ao meio (na escala log para a taxa de erro) quando o
+# goodput deles difere mais que essa fração, ou quando o IC de 95% de um deles
+# passa dessa fração da média, isto é, as LAB2_REPLICAS sementes discordam.
+# Cada dimensão tem um orçamento de pontos por curva.
+TOLERANCIA_ADAPTATIVA = float(os.environ["LAB2_ADAPTATIVO"]) if os.environ.get("LAB2_ADAPTATIVO") else None
+REPLICAS_ADAPTATIVO = int(os.environ.get("LAB2_REPLICAS", "1"))
+ORCAMENTO_DELAY = int(os.environ.get("LAB2_ORCAMENTO_DELAY", "12"))
+ORCAMENTO_ERRO = int(os.environ.get("LAB2_ORCAMENTO_ERRO", "12"))
+# Cache de resultados endereçado por conteúdo: cada ponto fica em
+# DIR_CACHE/<hash>, com o hash do build ID do executável e das bibliotecas do
+# ns-3, do nome do programa e de todos os parâmetros. Reexecutar o script só
+# simula os pontos novos; recompilar com outro código muda o build ID e
+# invalida o que foi guardado. LAB2_CACHE=0 desliga o cache e
+# LAB2_LIMPA_CACHE=1 o apaga antes de rodar.
+DIR_BUILD = "build"
+DIR_CACHE = os.path.join(DIR_SCRATCH, "cache")
+USA_CACHE = os.environ.get("LAB2_CACHE", "1") != "0"
+LIMPA_CACHE = os.environ.get("LAB2_LIMPA_CACHE") == "1"
+# Parâmetros que só dizem onde escrever ou quantos processos usar
+PARAMS_FORA_DA_CHAVE = ('outputPrefix', 'resultFile', 'forkJobs')
+estatisticas_cache = {'acertos': 0, 'faltas': 0}
+trava_cache = threading.Lock()
+ids_build = {}
 
 def prepara_dir():
     if os.path.exists("Lab2_Sobrenome_Nome"): shutil.rmtree("Lab2_Sobrenome_Nome")
+    if LIMPA_CACHE and os.path.exists(DIR_CACHE):
+        print(f"Apagando o cache de resultados em {DIR_CACHE}...")
+        shutil.rmtree(DIR_CACHE)
     os.makedirs(os.path.join("Lab2_Sobrenome_Nome", 'Part1', 'plots'), exist_ok=True)
     os.makedirs(os.path.join("Lab2_Sobrenome_Nome", 'Part2', 'plots'), exist_ok=True)
 
-def roda_simulacao(nome_executavel, parametros):
-    lista_args = [f"--{k}={v}" for k, v in parametros.items()]
+def compila():
+    # Compila uma vez antes das execuções concorrentes, que usam --no-build
+    subprocess.run([COMANDO_NS3, "build"], check=True)
+
+def dir_execucao(nome):
+    caminho = os.path.join(DIR_SCRATCH, "resultados", nome)
+    if os.path.exists(caminho): shutil.rmtree(caminho)
+    os.makedirs(caminho)
+    return caminho
+
+def executa_paralelo(funcao, tarefas):
+    # Roda funcao(*tarefa, nucleo=...) para cada tarefa num pool de N_WORKERS,
+    # prendendo cada worker a um núcleo, e devolve os resultados na ordem das tarefas
+    nucleos = sorted(os.sched_getaffinity(0))
+    livres = Queue()
+    for nucleo in nucleos[:max(1, N_WORKERS)]:
+        livres.put(nucleo)
+
+    def roda(tarefa):
+        nucleo = livres.get()
+        try:
+            return funcao(*tarefa, nucleo=nucleo)
+        finally:
+            livres.put(nucleo)
+
+    with ThreadPoolExecutor(max_workers=max(1, N_WORKERS)) as pool:
+        return list(pool.map(roda, tarefas))
+
+def comando_ns3(cmd_args, nucleo):
+    # O núcleo é fixado pelo taskset: preexec_fn não é seguro com as threads do pool
+    if nucleo is None:
+        return [COMANDO_NS3, "run", cmd_args]
+    return ["taskset", "-c", str(nucleo), COMANDO_NS3, "run", "--no-build", cmd_args]
+
+def id_build_arquivo(caminho):
+    # GNU build ID do ELF; sem ele (ou sem readelf), o hash do conteúdo
+    try:
+        saida = subprocess.run(["readelf", "-n", caminho], capture_output=True, text=True).stdout
+        achado = re.search(r"Build ID: ([0-9a-f]+)", saida)
+        if achado:
+            return achado.group(1)
+    except FileNotFoundError:
+        pass
+    h = hashlib.sha256()
+    with open(caminho, 'rb') as f:
+        for bloco in iter(lambda: f.read(1 << 20), b""):
+            h.update(bloco)
+    return h.hexdigest()
+
+def id_build(nome_executavel):
+    # Identifica o build do executável e das bibliotecas do ns-3 que ele carrega
+    # (o executável de scratch não muda quando só uma biblioteca muda), ou None
+    # se o programa ainda não foi compilado. Memorizado pela data dos arquivos.
+    executaveis = glob.glob(os.path.join(DIR_BUILD, "scratch", f"ns3*-{nome_executavel}-*"))
+    if not executaveis:
+        return None
+    arquivos = sorted(a for a in executaveis + glob.glob(os.path.join(DIR_BUILD, "lib", "libns3*"))
+                      if os.path.isfile(a))
+    estado = tuple((a, os.stat(a).st_mtime_ns) for a in arquivos)
+    if estado not in ids_build:
+        ids = "\n".join(f"{a} {id_build_arquivo(a)}" for a in arquivos)
+        ids_build[estado] = hashlib.sha256(ids.encode()).hexdigest()
+    return ids_build[estado]
+
+def chave_cache(nome_executavel, parametros):
+    # Hash do build, do programa e dos parâmetros; None com o cache desligado
+    build = id_build(nome_executavel) if USA_CACHE else None
+    if build is None:
+        return None
+    params = {k: v for k, v in parametros.items() if k not in PARAMS_FORA_DA_CHAVE}
+    conteudo = json.dumps({'build': build, 'programa': nome_executavel, 'params': params},
+                          sort_keys=True, default=str)
+    return hashlib.sha256(conteudo.encode()).hexdigest()
+
+def le_cache(chave):
+    # Resultado guardado sob a chave, ou None, contando acertos e faltas
+    if chave is None:
+        return None
+    caminho = os.path.join(DIR_CACHE, chave, "resultado.json")
+    achou = os.path.exists(caminho)
+    with trava_cache:
+        estatisticas_cache['acertos' if achou else 'faltas'] += 1
+    if not achou:
+        return None
+    with open(caminho) as f:
+        return json.load(f)
+
+def grava_cache(chave, resultado, prefixo=None):
+    # Os arquivos de saída do prefixo (traces, registros) vão junto, com o prefixo
+    # trocado por "p". A entrada é montada num diretório temporário e renomeada,
+    # então uma entrada pela metade nunca é lida.
+    if chave is None:
+        return
+    os.makedirs(DIR_CACHE, exist_ok=True)
+    tmp = tempfile.mkdtemp(dir=DIR_CACHE)
+    with open(os.path.join(tmp, "resultado.json"), 'w') as f:
+        json.dump(resultado, f)
+    if prefixo:
+        os.makedirs(os.path.join(tmp, "arquivos"))
+        for arq in glob.glob(glob.escape(prefixo) + "*"):
+            shutil.copy(arq, os.path.join(tmp, "arquivos", "p" + arq[len(prefixo):]))
+    try:
+        os.rename(tmp, os.path.join(DIR_CACHE, chave))
+    except OSError:
+        # Outra thread gravou a mesma chave antes
+        shutil.rmtree(tmp)
+
+def restaura_arquivos(chave, prefixo):
+    pasta = os.path.join(DIR_CACHE, chave, "arquivos")
+    if prefixo and os.path.isdir(pasta):
+        for nome in os.listdir(pasta):
+            shutil.copy(os.path.join(pasta, nome), prefixo + nome[1:])
+
+def resumo_cache():
+    acertos, faltas = estatisticas_cache['acertos'], estatisticas_cache['faltas']
+    if USA_CACHE and acertos + faltas:
+        print(f"\nCache ({DIR_CACHE}): {acertos} acertos, {faltas} faltas "
+              f"({100 * acertos / (acertos + faltas):.0f}% dos pontos reaproveitados)")
+
+def le_resultados(caminho):
+    # Registros JSON (--resultFile), um por linha e por execução
+    with open(caminho) as f:
+        return [json.loads(linha) for linha in f if linha.strip()]
+
+def roda_simulacao(nome_executavel, parametros, nucleo=None):
+    parametros = {**PARAMS_TRACE, **PARAMS_CONVERGENCIA, **parametros}
+    chave = chave_cache(nome_executavel, parametros)
+    guardado = le_cache(chave)
+    if guardado is not None:
+        restaura_arquivos(chave, parametros.get('outputPrefix'))
+        print(f"\nCache: {parametros.get('transport_prot', 'N/A')} | {parametros.get('nFlows', 0)} flows | {chave[:12]}")
+        return guardado
+    if 'outputPrefix' in parametros:
+        arq_resultado = parametros['outputPrefix'] + "-result.json"
+    else:
+        os.makedirs(os.path.join(DIR_SCRATCH, "resultados"), exist_ok=True)
+        fd, arq_resultado = tempfile.mkstemp(suffix="-result.json", dir=os.path.join(DIR_SCRATCH, "resultados"))
+        os.close(fd)
+    lista_args = [f"--{k}={v}" for k, v in parametros.items()] + [f"--resultFile={arq_resultado}"]
     cmd_args = f'{nome_executavel} {" ".join(lista_args)}'
-    cmd = [COMANDO_NS3, "run", cmd_args]
+    cmd = comando_ns3(cmd_args, nucleo)
     print(f"\nRodando: {parametros.get('transport_prot', 'N/A')} | {parametros.get('nFlows', 0)} flows | Args: {cmd_args}")
+    falha = {'goodput_agg': None, 'goodput_avg_d1': None, 'goodput_avg_d2': None, 'registro': None, 'saida': ""}
     try:
         resultado = subprocess.run(cmd, capture_output=True, text=True, check=True)
-        saida = resultado.stdout
-        
-        match_agg = re.search(r"Total Aggregate Goodput: ([\d\.e\+]+) bps", saida)
-        match_avg_d1 = re.search(r"Dest 1 \(Fast RTT\) \| Average Per-Flow Goodput: ([\d\.e\+]+) bps", saida)
-        match_avg_d2 = re.search(r"Dest 2 \(Slow RTT\) \| Average Per-Flow Goodput: ([\d\.e\+]+) bps", saida)
-
-        if match_agg and match_avg_d1 and match_avg_d2: 
-            return {
-                'goodput_agg': float(match_agg.group(1)),
-                'goodput_avg_d1': float(match_avg_d1.group(1)),
-                'goodput_avg_d2': float(match_avg_d2.group(1)),
-                'saida': saida
-            }
-        
-        match_agg_part1 = re.search(r"Goodput Agregado Total: ([\d\.e\+]+) bps", saida)
-        if match_agg_part1:
-            return {'goodput_agg': float(match_agg_part1.group(1)), 'saida': saida}
-            
-        print(f"Aviso: Goodput não encontrado para {parametros}")
-        return {'goodput_agg': None, 'saida': saida}
+        registros = le_resultados(arq_resultado)
+    except subprocess.CalledProcessError as e:
+        print(f"ERRO NS3 ({e.returncode}):\nComando: {' '.join(cmd)}\nStderr: {e.stderr}")
+        return falha
+    except FileNotFoundError:
+        print(f"ERRO: Comando '{cmd[0]}' não achado.")
+        return falha
+    except json.JSONDecodeError as e:
+        # Um registro ilegível perde só este ponto, não a varredura inteira
+        print(f"ERRO: registro de resultado inválido em {arq_resultado}: {e}")
+        return {**falha, 'saida': resultado.stdout}
+
+    if not registros:
+        print(f"Aviso: a execução não gerou registro de resultado para {parametros}")
+        return {**falha, 'saida': resultado.stdout}
+    # Com forkAt o primeiro registro é o da execução sem mudança e os outros
+    # são os das variantes
+    registro = registros[0]
+    res = {
+        'goodput_agg': registro['aggregateGoodput'],
+        'goodput_avg_d1': registro.get('avgGoodputDest1'),
+        'goodput_avg_d2': registro.get('avgGoodputDest2'),
+        'registro': registro,
+        'registros': registros,
+        'saida': resultado.stdout
+    }
+    # Uma variante que falhou é refeita na próxima vez, não lida do cache
+    if not any(r.get('failed') for r in registros):
+        grava_cache(chave, res, parametros.get('outputPrefix'))
+    return res
+
+def roda_lote(nome_executavel, linhas, nome_lote):
+    # Roda uma varredura inteira com --batchFile: cada linha é um dicionário de
+    # parâmetros, com 'seeds' opcional (lista de sementes). A média, o desvio
+    # padrão e o IC de 95% saem prontos do C++ (registros agg). Só as linhas sem
+    # registro no cache são simuladas; o resultado segue a ordem de linhas.
+    if not USA_CACHE:
+        return roda_fatias(nome_executavel, linhas, nome_lote)
+    compila()
+    chaves = [chave_cache(nome_executavel, {**PARAMS_TRACE, **PARAMS_CONVERGENCIA, **linha})
+              for linha in linhas]
+    guardados = [le_cache(chave) for chave in chaves]
+    faltando = [i for i, g in enumerate(guardados) if g is None]
+    if not faltando:
+        print(f"\nLote {nome_lote}: {len(linhas)} configurações do cache")
+        return pd.DataFrame(guardados)
+    agg = roda_fatias(nome_executavel, [linhas[i] for i in faltando], nome_lote)
+    if agg is None:
+        return None
+    for i, (_, registro) in zip(faltando, agg.iterrows()):
+        guardados[i] = json.loads(registro.to_json())
+        grava_cache(chaves[i], guardados[i])
+    return pd.DataFrame(guardados)
+
+def roda_fatias(nome_executavel, linhas, nome_lote):
+    # As linhas são divididas em fatias contíguas, uma invocação por worker
+    n_fatias = max(1, min(N_WORKERS, len(linhas)))
+    tamanho = -(-len(linhas) // n_fatias)
+    fatias = [(nome_executavel, linhas[i:i + tamanho], f"{nome_lote}-{i // tamanho}")
+              for i in range(0, len(linhas), tamanho)]
+    if len(fatias) == 1:
+        partes = [roda_fatia(*fatias[0])]
+    else:
+        compila()
+        partes = executa_paralelo(roda_fatia, fatias)
+    if any(p is None for p in partes):
+        return None
+    return pd.concat(partes, ignore_index=True)
 
+def roda_fatia(nome_executavel, linhas, nome_fatia, nucleo=None):
+    dir_lote = dir_execucao(f"lote-{nome_fatia}")
+    arq_lote = os.path.join(dir_lote, "lote.txt")
+    arq_csv = os.path.join(dir_lote, "lote.csv")
+    with open(arq_lote, 'w') as f:
+        for linha in linhas:
+            linha = {**PARAMS_TRACE, **PARAMS_CONVERGENCIA, 'outputPrefix': os.path.join(dir_lote, "run"), **linha}
+            if 'seeds' in linha:
+                linha['seeds'] = ",".join(str(s) for s in linha['seeds'])
+            f.write(" ".join(f"--{k}={v}" for k, v in linha.items()) + "\n")
+
+    cmd_args = f'{nome_executavel} --batchFile={arq_lote} --batchOutput={arq_csv}'
+    cmd = comando_ns3(cmd_args, nucleo)
+    print(f"\nRodando lote {nome_fatia}: {len(linhas)} configurações | Args: {cmd_args}")
+    try:
+        subprocess.run(cmd, capture_output=True, text=True, check=True)
     except subprocess.CalledProcessError as e:
         print(f"ERRO NS3 ({e.returncode}):\nComando: {' '.join(cmd)}\nStderr: {e.stderr}")
-        return {'goodput_agg': None, 'saida': ""}
+        return None
     except FileNotFoundError:
-        print(f"ERRO: Comando '{COMANDO_NS3}' não achado.")
-        return {'goodput_agg': None, 'saida': ""}
+        print(f"ERRO: Comando '{cmd[0]}' não achado.")
+        return None
+
+    registros = pd.read_csv(arq_csv)
+    return registros[registros['record'] == 'agg']
+
+def varredura_adaptativa(nome_executavel, curvas, dimensao, grade, orcamento, nome_lote, meio, formata):
+    # Refina cada curva (um dicionário de parâmetros fixos) ao longo de dimensao,
+    # partindo de grade e rodando uma rodada de roda_lote por vez com os pontos
+    # novos de todas as curvas. meio(a, b) dá o ponto entre dois vizinhos e
+    # formata(x) o valor do parâmetro. Devolve as linhas e o goodput como
+    # roda_lote, com os pontos de cada curva em ordem crescente.
+    resultados = {}
+    pendentes = [(i, x) for i in range(len(curvas)) for x in grade]
+    rodada = 0
+    while pendentes:
+        linhas = []
+        for i, x in pendentes:
+            linha = {**curvas[i], dimensao: formata(x)}
+            linha['seeds'] = [linha.pop('seed') + k for k in range(max(1, REPLICAS_ADAPTATIVO))]
+            linhas.append(linha)
+        agg = roda_lote(nome_executavel, linhas, f"{nome_lote}-r{rodada}")
+        if agg is None:
+            break
+        for (i, x), goodput, ic in zip(pendentes, agg['goodput'], agg['goodput_ci95']):
+            resultados[(i, x)] = (goodput, ic if ic == ic else 0)
+
+        pendentes = []
+        for i in range(len(curvas)):
+            xs = sorted(x for j, x in resultados if j == i)
+            candidatos = []
+            for a, b in zip(xs, xs[1:]):
+                (ga, ica), (gb, icb) = resultados[(i, a)], resultados[(i, b)]
+                diferenca = abs(ga - gb) / max(ga, gb, 1e-9)
+                incerteza = max(ica / max(ga, 1e-9), icb / max(gb, 1e-9))
+                m = meio(a, b)
+                if max(diferenca, incerteza) > TOLERANCIA_ADAPTATIVA and m not in (a, b):
+                    candidatos.append((max(diferenca, incerteza), m))
+            # Os intervalos que mais variam primeiro, até o orçamento da curva
+            candidatos.sort(reverse=True)
+            pendentes += [(i, m) for _, m in candidatos[:max(0, orcamento - len(xs))]]
+        rodada += 1
+
+    chaves = sorted(resultados)
+    print(f"\nVarredura adaptativa {nome_lote}: {len(chaves)} pontos em {rodada} rodadas "
+          f"({len(chaves) / max(1, len(curvas)):.1f} por curva, orçamento {orcamento})")
+    if not chaves:
+        return [{**curvas[i], dimensao: formata(x)} for i in range(len(curvas)) for x in grade], None
+    linhas = [{**curvas[i], dimensao: formata(x)} for i, x in chaves]
+    return linhas, {'goodput': [resultados[c][0] for c in chaves]}
 
-def move_trace(dir_base, nome_parte, prot):
+def move_trace(dir_base, nome_parte, prot, src=CAMINHO_TRACE_FIXO_1):
     pasta_destino = os.path.join(dir_base, nome_parte, prot)
     os.makedirs(pasta_destino, exist_ok=True)
-    src = CAMINHO_TRACE_FIXO_1
     dst = os.path.join(pasta_destino, ARQ_TRACE_FIXO)
     if os.path.exists(src):
         shutil.move(src, dst)
-        print(f"Trace CWND movido para {dst}")
+        print(f"Trace TCP movido para {dst}")
         return dst
     else:
         return None
 
-def le_cwnd(caminho):
-    dados = pd.read_csv(caminho, sep='\s+', header=None, names=['Tempo', 'Cwnd'])
-    return dados['Tempo'].tolist(), dados['Cwnd'].tolist()
+def le_cwnd(caminho, fluxo=0):
+    # Trace multiplexado: "tempo fluxo metrica valor"
+    dados = pd.read_csv(caminho, sep='\s+', header=None, names=['Tempo', 'Fluxo', 'Metrica', 'Valor'])
+    dados = dados[(dados['Fluxo'] == fluxo) & (dados['Metrica'] == 'cwnd')]
+    return dados['Tempo'].tolist(), dados['Valor'].tolist()
 
 
 def parte_1a():
@@ -75,17 +375,26 @@ def parte_1a():
     resultados = {}
     dir_base = "Lab2_Sobrenome_Nome"
 
-    prot_c = "TcpCubic"
-    params_c = cfg1a.copy(); params_c['transport_prot'] = prot_c
-    res_c = roda_simulacao(NOME_PROGRAMA_PART1, params_c)
-    resultados[prot_c] = res_c['goodput_agg']
-    caminho_c = move_trace(dir_base, 'Part1', prot_c)
+    cfg4f = {'dataRate': "10Mbps", 'delay': "100ms", 'errorRate': 0.00001, 'nFlows': 4, 'seed': 1}
+    protocolos = ["TcpCubic", "TcpNewReno"]
+
+    # Os quatro pontos (1 flow e 4 flows por protocolo) rodam juntos, cada um
+    # com o próprio diretório de saída
+    tarefas = []
+    for prot in protocolos:
+        tarefas.append((NOME_PROGRAMA_PART1, {**cfg1a, 'transport_prot': prot,
+                        'outputPrefix': os.path.join(dir_execucao(f"1a-{prot}"), "Congestion_Control")}))
+    for prot in protocolos:
+        tarefas.append((NOME_PROGRAMA_PART1, {**cfg4f, 'transport_prot': prot,
+                        'outputPrefix': os.path.join(dir_execucao(f"1a-4f-{prot}"), "Congestion_Control")}))
+    compila()
+    res_1f_c, res_1f_r, res_4f_c, res_4f_r = executa_paralelo(roda_simulacao, tarefas)
 
-    prot_r = "TcpNewReno"
-    params_r = cfg1a.copy(); params_r['transport_prot'] = prot_r
-    res_r = roda_simulacao(NOME_PROGRAMA_PART1, params_r)
-    resultados[prot_r] = res_r['goodput_agg']
-    caminho_r = move_trace(dir_base, 'Part1', prot_r)
+    prot_c, prot_r = protocolos
+    resultados[prot_c] = res_1f_c['goodput_agg']
+    resultados[prot_r] = res_1f_r['goodput_agg']
+    caminho_c = move_trace(dir_base, 'Part1', prot_c, tarefas[0][1]['outputPrefix'] + "-tcp.data")
+    caminho_r = move_trace(dir_base, 'Part1', prot_r, tarefas[1][1]['outputPrefix'] + "-tcp.data")
 
     if caminho_c and caminho_r:
         try:
@@ -104,12 +413,8 @@ def parte_1a():
         except Exception as e:
             print(f"Erro ao ler CWND: {e}")
     
-    cfg4f = {'dataRate': "10Mbps", 'delay': "100ms", 'errorRate': 0.00001, 'nFlows': 4, 'seed': 1}
     dir_p1 = os.path.join(dir_base, 'Part1')
-    for prot_ex in ["TcpCubic", "TcpNewReno"]:
-        params_4f = cfg4f.copy(); params_4f['transport_prot'] = prot_ex
-        print(f"Rodando amostra (4 flows, 1a config): {prot_ex}")
-        res_4f = roda_simulacao(NOME_PROGRAMA_PART1, params_4f)
+    for prot_ex, res_4f in zip(protocolos, [res_4f_c, res_4f_r]):
         nome_saida = f'Part1a_SampleOutput_4Flows_{prot_ex}.txt'
         with open(os.path.join(dir_p1, nome_saida), 'w') as f:
             f.write(res_4f['saida'])
@@ -122,22 +427,24 @@ def parte_1b():
     cfg_fixa = {'dataRate': "1Mbps", 'errorRate': 0.00001, 'seed': 2}
     delays = ["50ms", "100ms", "150ms", "200ms", "250ms", "300ms"]
     n_flows = [1, 2, 4]; protocolos = ["TcpCubic", "TcpNewReno"]
+    if TOLERANCIA_ADAPTATIVA:
+        curvas = [{**cfg_fixa, 'transport_prot': prot, 'nFlows': n} for prot in protocolos for n in n_flows]
+        linhas, agg = varredura_adaptativa(NOME_PROGRAMA_PART1, curvas, 'delay', [50, 175, 300],
+                                           ORCAMENTO_DELAY, "1b", meio=lambda a, b: (a + b) // 2,
+                                           formata=lambda x: f"{x}ms")
+    else:
+        linhas = [{**cfg_fixa, 'transport_prot': prot, 'nFlows': n, 'delay': d}
+                  for prot in protocolos for n in n_flows for d in delays]
+        agg = roda_lote(NOME_PROGRAMA_PART1, linhas, "1b")
+
     dados = []
-    
-    for prot in protocolos:
-        for n in n_flows:
-            for d in delays:
-                params = cfg_fixa.copy()
-                params.update({'transport_prot': prot, 'nFlows': n, 'delay': d})
-                
-                res = roda_simulacao(NOME_PROGRAMA_PART1, params) 
-                goodput_agg = res['goodput_agg']
-                
-                d_ms = int(d.replace("ms", ""))
-                dados.append({
-                    'Delay': d_ms, 'NFlows': n, 'Protocol': prot,
-                    'Goodput': (goodput_agg / 1e6) if goodput_agg is not None else 0
-                })
+    for i, linha in enumerate(linhas):
+        goodput_agg = agg['goodput'][i] if agg is not None else None
+        dados.append({
+            'Delay': int(linha['delay'].replace("ms", "")), 'NFlows': linha['nFlows'],
+            'Protocol': linha['transport_prot'],
+            'Goodput': (goodput_agg / 1e6) if goodput_agg is not None else 0
+        })
                 
     df1b = pd.DataFrame(dados)
     plt.figure(figsize=(10, 7))
@@ -153,26 +460,56 @@ def parte_1b():
     print(f"Gráfico 1b salvo.")
     return df1b
 
+def roda_variantes_erro(cfg_fixa, protocolos, n_flows, erros, linhas):
+    # Uma execução por protocolo e nº de fluxos; as outras taxas de erro são
+    # variantes bifurcadas em FORK_AT. Devolve o goodput na ordem de linhas.
+    n_execucoes = len(protocolos) * len(n_flows)
+    variantes = ",".join(f"errorRate={erro}" for erro in erros[1:])
+    tarefas = [(NOME_PROGRAMA_PART1, {**cfg_fixa, 'transport_prot': prot, 'nFlows': n,
+                'errorRate': erros[0], 'forkAt': FORK_AT, 'forkVariants': variantes,
+                'forkJobs': max(1, N_WORKERS // n_execucoes),
+                'outputPrefix': os.path.join(dir_execucao(f"1c-fork-{prot}-{n}"), "run")})
+               for prot in protocolos for n in n_flows]
+    compila()
+    goodput = {}
+    for res in executa_paralelo(roda_simulacao, tarefas):
+        for registro in res.get('registros') or []:
+            p = registro['params']
+            if registro.get('failed'):
+                # Fica sem goodput (None), e não zero, no gráfico
+                print(f"ERRO: variante {p['transport_prot']} | {p['nFlows']} flows | errorRate={p['errorRate']}"
+                      f" falhou ({registro.get('error')}); saída em {registro['prefix']}.out")
+            goodput[(p['transport_prot'], p['nFlows'], p['errorRate'])] = registro['aggregateGoodput']
+    return {'goodput': [goodput.get((l['transport_prot'], l['nFlows'], l['errorRate'])) for l in linhas]}
+
 def parte_1c():
     print("Iniciando Parte 1c")
     cfg_fixa = {'dataRate': "1Mbps", 'delay': "1ms", 'seed': 3}
     erros = [0.00001, 0.00005, 0.0001, 0.0005, 0.001]
     n_flows = [1, 2, 4]; protocolos = ["TcpCubic", "TcpNewReno"]
+    linhas = [{**cfg_fixa, 'transport_prot': prot, 'nFlows': n, 'errorRate': erro}
+              for prot in protocolos for n in n_flows for erro in erros]
+    if TOLERANCIA_ADAPTATIVA:
+        # Faixa larga, de 1e-6 a 1e-2, com pontos médios geométricos de 2 algarismos
+        curvas = [{**cfg_fixa, 'transport_prot': prot, 'nFlows': n} for prot in protocolos for n in n_flows]
+        linhas, agg = varredura_adaptativa(NOME_PROGRAMA_PART1, curvas, 'errorRate', [1e-6, 1e-4, 1e-2],
+                                           ORCAMENTO_ERRO, "1c",
+                                           meio=lambda a, b: float(f"{math.sqrt(a * b):.2g}"),
+                                           formata=lambda x: x)
+    elif FORK_AT:
+        agg = roda_variantes_erro(cfg_fixa, protocolos, n_flows, erros, linhas)
+    else:
+        agg = roda_lote(NOME_PROGRAMA_PART1, linhas, "1c")
+
     dados = []
-    
-    for prot in protocolos:
-        for n in n_flows:
-            for erro in erros:
-                params = cfg_fixa.copy()
-                params.update({'transport_prot': prot, 'nFlows': n, 'errorRate': erro})
-                
-                res = roda_simulacao(NOME_PROGRAMA_PART1, params)
-                goodput_agg = res['goodput_agg']
-                
-                dados.append({
-                    'ErrorRate': erro, 'NFlows': n, 'Protocol': prot,
-                    'Goodput': (goodput_agg / 1e6) if goodput_agg is not None else 0
-                })
+    for i, linha in enumerate(linhas):
+        goodput_agg = agg['goodput'][i] if agg is not None else None
+        dados.append({
+            'ErrorRate': linha['errorRate'], 'NFlows': linha['nFlows'],
+            'Protocol': linha['transport_prot'],
+            # Ponto que falhou fica vazio no gráfico em vez de aparecer como 0
+            'Goodput': (goodput_agg / 1e6) if goodput_agg is not None else float('nan')
+        })
                 
     df1c = pd.DataFrame(dados)
     plt.figure(figsize=(10, 7))
@@ -206,42 +543,34 @@ def executa_2():
     dir_base = "Lab2_Sobrenome_Nome"
     dir_p2 = os.path.join(dir_base, 'Part2')
     
-    for prot in protocolos:
-        for n in n_flows:
-            goodputs_d1 = []
-            goodputs_d2 = []
-            
-            for run in range(n_runs):
-                seed_atual = cfg_fixa['seed'] + run
-                
-                params = cfg_fixa.copy()
-                params.update({'transport_prot': prot, 'nFlows': n, 'seed': seed_atual})
+    # Amostra de saída de uma execução isolada (4 flows, primeira semente)
+    tarefas = [(NOME_PROGRAMA_PART2, {**cfg_fixa, 'transport_prot': prot, 'nFlows': 4,
+                'outputPrefix': os.path.join(dir_execucao(f"2-amostra-{prot}"), "lab2-part2")})
+               for prot in protocolos]
+    compila()
+    for prot, res in zip(protocolos, executa_paralelo(roda_simulacao, tarefas)):
+        nome_saida = f'Part2_SampleOutput_4Flows_{prot}.txt'
+        with open(os.path.join(dir_p2, nome_saida), 'w') as f:
+            f.write(res['saida'])
 
-                res = roda_simulacao(NOME_PROGRAMA_PART2, params)
-                
-                if res['goodput_avg_d1'] is not None and res['goodput_avg_d2'] is not None:
-                    goodputs_d1.append(res['goodput_avg_d1'])
-                    goodputs_d2.append(res['goodput_avg_d2'])
-                
-                if n == 4 and run == 0:
-                    nome_saida = f'Part2_SampleOutput_4Flows_{prot}.txt'
-                    with open(os.path.join(dir_p2, nome_saida), 'w') as f:
-                        f.write(res['saida'])
-                        
-            if goodputs_d1 and goodputs_d2:
-                avg_d1 = sum(goodputs_d1) / n_runs
-                avg_d2 = sum(goodputs_d2) / n_runs
-                
-                dados_totais.append({
-                    'Protocol': prot, 'NFlows': n, 'Dest': 'Dest1 (Fast RTT)', 
-                    'Goodput_Avg': avg_d1 / 1e6
-                })
-                dados_totais.append({
-                    'Protocol': prot, 'NFlows': n, 'Dest': 'Dest2 (Slow RTT)', 
-                    'Goodput_Avg': avg_d2 / 1e6
-                })
-            else:
-                print(f"AVISO: Não foram obtidos dados de goodput para {prot}, {n} flows.")
+    # Todas as replicações numa única invocação; as médias vêm do C++
+    sementes = [cfg_fixa['seed'] + run for run in range(n_runs)]
+    linhas = [{**cfg_fixa, 'transport_prot': prot, 'nFlows': n, 'seeds': sementes}
+              for prot in protocolos for n in n_flows]
+    for linha in linhas:
+        del linha['seed']
+    agg = roda_lote(NOME_PROGRAMA_PART2, linhas, "2")
+
+    for i, linha in enumerate(linhas):
+        if agg is None or agg['runs'][i] < n_runs:
+            print(f"AVISO: Não foram obtidos dados de goodput para {linha['transport_prot']}, {linha['nFlows']} flows.")
+            continue
+        for dest, col in (('Dest1 (Fast RTT)', 'goodput_avg_d1'), ('Dest2 (Slow RTT)', 'goodput_avg_d2')):
+            dados_totais.append({
+                'Protocol': linha['transport_prot'], 'NFlows': linha['nFlows'], 'Dest': dest,
+                'Goodput_Avg': agg[col][i] / 1e6,
+                'Goodput_IC95': agg[col + '_ci95'][i] / 1e6
+            })
 
     df2 = pd.DataFrame(dados_totais)
     
@@ -277,4 +606,5 @@ print(f"RENO: {r_1a.get('TcpNewReno'):.2f} bps")
 
 df_2 = executa_2()
 
+resumo_cache()
 print("\nExecução de todas as partes concluída.")
\ No newline at end of file
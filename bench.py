@@ -0,0 +1,326 @@
+import argparse, json, os, re, statistics, subprocess, sys, time
+
+# Suíte de benchmark dos labs: roda configurações fixas e com semente de cada
+# programa, várias vezes, e compara tempo de parede, pico de RSS, eventos e
+# eventos/s com um baseline salvo, marcando regressões acima do limiar.
+#
+# Uso: python3 bench.py [--reps 5] [--threshold 0.10] [--filtro lab2]
+#                       [--baseline bench-baseline.json] [--salva-baseline]
+#      python3 bench.py --escalonadores [--escalas 8,128,2048] [--reps 3]
+#      python3 bench.py --celula [--stas 50,200,1000] [--reps 3]
+#      python3 bench.py --bss [--n-bss 2,4,8,16] [--reps 3]
+#      python3 bench.py --lan [--hosts 5,50,500] [--reps 3]
+#
+# Com --escalonadores roda o mesmo cenário do lab2-part2 com cada escalonador
+# de eventos em cada escala, confere que os resultados são idênticos e indica
+# o mais rápido por escala.
+#
+# Com --celula roda o modo largeCell do lab1-part3 com o canal exaustivo e com
+# o canal em grade (alcance limitado) em cada número de STAs, e mostra o ganho
+# de tempo e quanto o goodput do canal em grade se afasta do exaustivo.
+#
+# Com --bss roda o lab1-part3 com K BSSs, com canais isolados e com um canal
+# compartilhado, e mostra como o tempo de parede e o goodput por BSS variam
+# com K.
+#
+# Com --lan roda o lab1-part2 com a LAN num canal CSMA compartilhado e como
+# switch, com um cliente de eco em cada nó da LAN e o servidor de eco na
+# própria LAN, e mostra a latência de eco e os eventos/s em cada número de nós.
+
+COMANDO_NS3 = "./ns3"
+ARQ_BASELINE = "bench-baseline.json"
+DIR_BENCH = os.path.join("scratch", "resultados", "bench")
+SEMENTE = {'RngSeed': 1, 'RngRun': 1}
+
+CONFIGURACOES = [
+    ("lab1-part1-5clientes", "lab1-part1", {'nClients': 5, 'nPackets': 5}),
+    ("lab1-part2-3csma", "lab1-part2", {'nCsma': 3, 'nPackets': 5}),
+    ("lab1-part3-9sta", "lab1-part3", {'nWifi': 9, 'nPackets': 5}),
+    ("lab2-part1-1f-cubic", "lab2-part1", {'nFlows': 1, 'transport_prot': "TcpCubic", 'seed': 1}),
+    ("lab2-part1-1f-newreno", "lab2-part1", {'nFlows': 1, 'transport_prot': "TcpNewReno", 'seed': 1}),
+    ("lab2-part1-4f-cubic", "lab2-part1", {'nFlows': 4, 'transport_prot': "TcpCubic", 'seed': 1}),
+    ("lab2-part1-4f-newreno", "lab2-part1", {'nFlows': 4, 'transport_prot': "TcpNewReno", 'seed': 1}),
+    ("lab2-part1-8f-cubic", "lab2-part1", {'nFlows': 8, 'transport_prot': "TcpCubic", 'seed': 1}),
+    ("lab2-part2-8f-cubic", "lab2-part2", {'nFlows': 8, 'transport_prot': "TcpCubic", 'seed': 8080}),
+]
+
+ESCALONADORES = ["map", "list", "heap", "calendar", "priority"]
+ESCALAS_FLUXOS = [8, 128, 2048]
+ESCALAS_STAS = [50, 200, 1000]
+ESCALAS_BSS = [2, 4, 8, 16]
+STAS_POR_BSS = 9
+DISTANCIA_BSS = 30
+ESCALAS_HOSTS = [5, 50, 500]
+MODOS_LAN = ["csma", "switch"]
+
+# Resultados da simulação guardados da primeira repetição (iguais em todas)
+CAMPOS_RESULTADO = ('rx', 'respostas', 'goodput', 'goodput_bss', 'perda', 'rtt_p50', 'rtt_p99')
+
+# Linha de resumo do --profile (PhaseProfiler::Report)
+RE_PROFILE = re.compile(r"^profile: ([\d.e+-]+) s wall \| run ([\d.e+-]+) s \| (\d+) events", re.M)
+# Linha de resumo do modo largeCell do lab1-part3
+RE_CELULA = re.compile(r"^Cell: \d+ STAs x \d+ BSSs \| (\d+) replies of \d+ requests \| goodput ([\d.e+-]+) bps",
+                       re.M)
+# Linha de resumo do EchoRttMonitor::Report dos lab1
+RE_RTT = re.compile(r"^RTT: (\d+) replies of (\d+) requests \| loss ([\d.e+-]+)% \| p50 ([\d.e+-]+) ms"
+                    r" \| p90 [\d.e+-]+ ms \| p99 ([\d.e+-]+) ms", re.M)
+RE_BSS = re.compile(r"^BSS \d+: \d+ replies of \d+ requests \| goodput ([\d.e+-]+) bps", re.M)
+
+
+def roda_uma(programa, parametros, nome):
+    arq_resultado = None
+    if programa.startswith("lab2"):
+        arq_resultado = os.path.join(DIR_BENCH, nome + "-result.json")
+        parametros = {**parametros, 'outputPrefix': os.path.join(DIR_BENCH, nome),
+                      'resultFile': arq_resultado}
+    args = " ".join(f"--{k}={v}" for k, v in {**SEMENTE, **parametros, 'profile': 1}.items())
+    cmd = [COMANDO_NS3, "run", "--no-build", f"{programa} {args}"]
+    inicio = time.perf_counter()
+    proc = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+    saida, erro = proc.communicate()
+    parede = time.perf_counter() - inicio
+    if proc.returncode != 0:
+        raise RuntimeError(f"{nome} falhou ({proc.returncode}):\n{erro}")
+    m = RE_PROFILE.search(saida)
+    if not m:
+        raise RuntimeError(f"{nome}: resumo do --profile não encontrado na saída")
+    eventos = int(m.group(3))
+    tempo_run = float(m.group(2))
+    amostra = {'parede': parede, 'programa': float(m.group(1)), 'eventos': eventos,
+               'eventos_s': eventos / tempo_run if tempo_run > 0 else 0}
+    if arq_resultado:
+        with open(arq_resultado) as f:
+            amostra['rx'] = json.loads(f.read().splitlines()[-1])['rxBytes']
+    m = RE_CELULA.search(saida)
+    if m:
+        amostra['respostas'] = int(m.group(1))
+        amostra['goodput'] = float(m.group(2))
+        amostra['goodput_bss'] = [float(g) for g in RE_BSS.findall(saida)]
+    m = RE_RTT.search(saida)
+    if m:
+        amostra['perda'] = float(m.group(3))
+        amostra['rtt_p50'] = float(m.group(4))
+        amostra['rtt_p99'] = float(m.group(5))
+    return amostra
+
+
+def pico_rss_filhos():
+    import resource
+    return resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss * 1024
+
+
+def roda_config(nome, programa, parametros, reps):
+    amostras = []
+    for _ in range(reps):
+        amostras.append(roda_uma(programa, parametros, nome))
+    # ru_maxrss dos filhos é o maior pico já visto; por isso cada configuração
+    # roda num processo filho próprio (ver mede_isolado)
+    return {
+        'parede': statistics.mean(a['parede'] for a in amostras),
+        'parede_sd': statistics.stdev(a['parede'] for a in amostras) if reps > 1 else 0.0,
+        'programa': statistics.mean(a['programa'] for a in amostras),
+        'eventos': amostras[0]['eventos'],
+        'eventos_s': statistics.mean(a['eventos_s'] for a in amostras),
+        'reps': reps,
+        **{k: amostras[0][k] for k in CAMPOS_RESULTADO if k in amostras[0]},
+    }
+
+
+def roda_escalonador(n_fluxos, escalonador, reps):
+    # bulkSetup deixa o custo de montagem baixo mesmo com milhares de fluxos
+    parametros = {'nFlows': n_fluxos, 'bulkSetup': 1, 'duration': 10, 'seed': 8080,
+                  'scheduler': escalonador}
+    nome = f"escalonador-{n_fluxos}f-{escalonador}"
+    return roda_config(nome, "lab2-part2", parametros, reps)
+
+
+def roda_celula(n_stas, exaustivo, reps):
+    parametros = {'largeCell': 1, 'nWifi': n_stas, 'nPackets': 3, 'verbose': 0,
+                  'exhaustive': int(exaustivo)}
+    nome = f"celula-{n_stas}sta-{'exaustivo' if exaustivo else 'grade'}"
+    return roda_config(nome, "lab1-part3", parametros, reps)
+
+
+def roda_bss(n_bss, compartilhado, reps):
+    parametros = {'nCells': n_bss, 'nWifi': STAS_POR_BSS, 'nPackets': 5, 'verbose': 0,
+                  'cellDistance': DISTANCIA_BSS, 'sharedChannel': int(compartilhado)}
+    nome = f"bss-{n_bss}-{'compartilhado' if compartilhado else 'isolado'}"
+    return roda_config(nome, "lab1-part3", parametros, reps)
+
+
+def roda_lan(n_hosts, modo, reps):
+    # O servidor fica na LAN: atrás do enlace p2p de 5 Mbps a comparação
+    # mediria a fila desse enlace, não a LAN
+    parametros = {'nCsma': n_hosts, 'nPackets': 10, 'lan': modo, 'lanClients': 1, 'lanServer': 1}
+    return roda_config(f"lan-{n_hosts}hosts-{modo}", "lab1-part2", parametros, reps)
+
+
+def mede_isolado(funcao, *args):
+    # Roda a medição num interpretador novo para que o pico de RSS dos filhos
+    # seja só dela
+    codigo = (f"import bench, json; r = bench.{funcao}(*{args!r});"
+              f"r['pico_rss'] = bench.pico_rss_filhos(); print(json.dumps(r))")
+    proc = subprocess.run([sys.executable, "-c", codigo], capture_output=True, text=True,
+                          cwd=os.getcwd(), env={**os.environ, 'PYTHONPATH': os.path.dirname(os.path.abspath(__file__))})
+    if proc.returncode != 0:
+        raise RuntimeError(proc.stderr)
+    return json.loads(proc.stdout.strip().splitlines()[-1])
+
+
+def variacao(atual, base):
+    return (atual - base) / base if base else 0.0
+
+
+def compara(resultados, baseline, limiar):
+    print(f"\n{'configuração':<24} {'parede (s)':>14} {'base':>8} {'Δ':>7} {'pico RSS (MB)':>13} {'Δ':>7}"
+          f" {'eventos':>10} {'eventos/s':>11} {'Δ':>7}  status")
+    regressoes = 0
+    for nome, r in resultados.items():
+        b = baseline.get(nome)
+        linha = (f"{nome:<24} {r['parede']:>8.3f}±{r['parede_sd']:<5.3f}"
+                 f" {b['parede'] if b else float('nan'):>8.3f}")
+        status = "novo"
+        if b:
+            d_parede = variacao(r['parede'], b['parede'])
+            d_rss = variacao(r['pico_rss'], b['pico_rss'])
+            d_eps = variacao(r['eventos_s'], b['eventos_s'])
+            falhas = []
+            if d_parede > limiar: falhas.append("tempo")
+            if d_rss > limiar: falhas.append("memória")
+            if d_eps < -limiar: falhas.append("eventos/s")
+            if r['eventos'] != b['eventos']: falhas.append("nº de eventos mudou")
+            status = "REGRESSÃO: " + ", ".join(falhas) if falhas else "ok"
+            regressoes += bool(falhas)
+            linha += (f" {d_parede:>+7.1%} {r['pico_rss'] / 2**20:>13.1f} {d_rss:>+7.1%}"
+                      f" {r['eventos']:>10} {r['eventos_s']:>11.0f} {d_eps:>+7.1%}")
+        else:
+            linha += (f" {'':>7} {r['pico_rss'] / 2**20:>13.1f} {'':>7}"
+                      f" {r['eventos']:>10} {r['eventos_s']:>11.0f} {'':>7}")
+        print(f"{linha}  {status}")
+    return regressoes
+
+
+def compara_escalonadores(escalas, reps):
+    print(f"\n{'fluxos':>7} {'escalonador':<12} {'eventos':>10} {'eventos/s':>11} {'pico RSS (MB)':>13}  resultado")
+    recomendacoes = []
+    divergencias = 0
+    for n_fluxos in escalas:
+        medidas = {}
+        for escalonador in ESCALONADORES:
+            medidas[escalonador] = mede_isolado("roda_escalonador", n_fluxos, escalonador, reps)
+        # Todos os escalonadores precisam produzir a mesma execução do map
+        referencia = medidas["map"]
+        for escalonador, r in medidas.items():
+            igual = r['eventos'] == referencia['eventos'] and r['rx'] == referencia['rx']
+            divergencias += not igual
+            print(f"{n_fluxos:>7} {escalonador:<12} {r['eventos']:>10} {r['eventos_s']:>11.0f}"
+                  f" {r['pico_rss'] / 2**20:>13.1f}  {'idêntico' if igual else 'DIVERGENTE'}")
+        melhor = max(medidas, key=lambda e: medidas[e]['eventos_s'])
+        ganho = variacao(medidas[melhor]['eventos_s'], referencia['eventos_s'])
+        recomendacoes.append(f"{n_fluxos} fluxos: usar {melhor} ({ganho:+.1%} eventos/s sobre map)")
+    print("\nRecomendação por escala:")
+    for linha in recomendacoes:
+        print(f"  {linha}")
+    return divergencias
+
+
+def compara_celula(escalas, reps):
+    print(f"\n{'STAs':>6} {'exaustivo (s)':>13} {'grade (s)':>10} {'ganho':>7}"
+          f" {'goodput exaustivo':>17} {'goodput grade':>13} {'Δ goodput':>9} {'Δ respostas':>11}")
+    for n_stas in escalas:
+        exaustivo = mede_isolado("roda_celula", n_stas, True, reps)
+        grade = mede_isolado("roda_celula", n_stas, False, reps)
+        ganho = exaustivo['parede'] / grade['parede'] if grade['parede'] else float('nan')
+        print(f"{n_stas:>6} {exaustivo['parede']:>13.3f} {grade['parede']:>10.3f} {ganho:>6.2f}x"
+              f" {exaustivo['goodput']:>17.0f} {grade['goodput']:>13.0f}"
+              f" {variacao(grade['goodput'], exaustivo['goodput']):>+9.2%}"
+              f" {grade['respostas'] - exaustivo['respostas']:>+11d}")
+
+
+def compara_bss(escalas, reps):
+    print(f"\n{'BSSs':>5} {'canal':<13} {'parede (s)':>10} {'eventos/s':>11} {'goodput total':>13}"
+          f" {'goodput/BSS':>11} {'pior BSS':>9}")
+    for n_bss in escalas:
+        for compartilhado in (False, True):
+            r = mede_isolado("roda_bss", n_bss, compartilhado, reps)
+            por_bss = r['goodput_bss']
+            print(f"{n_bss:>5} {'compartilhado' if compartilhado else 'isolado':<13} {r['parede']:>10.3f}"
+                  f" {r['eventos_s']:>11.0f} {r['goodput']:>13.0f} {statistics.mean(por_bss):>11.0f}"
+                  f" {min(por_bss):>9.0f}")
+
+
+def compara_lan(escalas, reps):
+    print(f"\n{'nós':>5} {'LAN':<7} {'parede (s)':>10} {'eventos':>10} {'eventos/s':>11}"
+          f" {'RTT p50 (ms)':>12} {'RTT p99 (ms)':>12} {'perda':>7}")
+    for n_hosts in escalas:
+        for modo in MODOS_LAN:
+            r = mede_isolado("roda_lan", n_hosts, modo, reps)
+            print(f"{n_hosts:>5} {modo:<7} {r['parede']:>10.3f} {r['eventos']:>10} {r['eventos_s']:>11.0f}"
+                  f" {r['rtt_p50']:>12.3f} {r['rtt_p99']:>12.3f} {r['perda']:>6.1f}%")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark das configurações fixas dos labs")
+    parser.add_argument("--reps", type=int, default=5, help="repetições por configuração")
+    parser.add_argument("--threshold", type=float, default=0.10, help="variação que conta como regressão")
+    parser.add_argument("--baseline", default=ARQ_BASELINE, help="arquivo do baseline")
+    parser.add_argument("--salva-baseline", action="store_true", help="grava os resultados como novo baseline")
+    parser.add_argument("--filtro", default="", help="só configurações cujo nome contém este texto")
+    parser.add_argument("--escalonadores", action="store_true",
+                        help="compara os escalonadores de eventos no lab2-part2")
+    parser.add_argument("--escalas", default=",".join(map(str, ESCALAS_FLUXOS)),
+                        help="números de fluxos do modo --escalonadores")
+    parser.add_argument("--celula", action="store_true",
+                        help="compara o canal em grade com o exaustivo no modo largeCell do lab1-part3")
+    parser.add_argument("--stas", default=",".join(map(str, ESCALAS_STAS)),
+                        help="números de STAs por BSS do modo --celula")
+    parser.add_argument("--bss", action="store_true",
+                        help="varia o número de BSSs do lab1-part3 com canais isolados e compartilhado")
+    parser.add_argument("--n-bss", default=",".join(map(str, ESCALAS_BSS)),
+                        help="números de BSSs do modo --bss")
+    parser.add_argument("--lan", action="store_true",
+                        help="compara a LAN CSMA compartilhada com a comutada no lab1-part2")
+    parser.add_argument("--hosts", default=",".join(map(str, ESCALAS_HOSTS)),
+                        help="números de nós extras da LAN do modo --lan")
+    args = parser.parse_args()
+
+    os.makedirs(DIR_BENCH, exist_ok=True)
+    subprocess.run([COMANDO_NS3, "build"], check=True)
+
+    if args.escalonadores:
+        escalas = [int(n) for n in args.escalas.split(",")]
+        sys.exit(1 if compara_escalonadores(escalas, args.reps) else 0)
+
+    if args.celula:
+        compara_celula([int(n) for n in args.stas.split(",")], args.reps)
+        return
+
+    if args.bss:
+        compara_bss([int(n) for n in args.n_bss.split(",")], args.reps)
+        return
+
+    if args.lan:
+        compara_lan([int(n) for n in args.hosts.split(",")], args.reps)
+        return
+
+    resultados = {}
+    for nome, programa, parametros in CONFIGURACOES:
+        if args.filtro in nome:
+            print(f"Rodando {nome} ({args.reps}x)")
+            resultados[nome] = mede_isolado("roda_config", nome, programa, parametros, args.reps)
+
+    baseline = {}
+    if os.path.exists(args.baseline):
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+    regressoes = compara(resultados, baseline, args.threshold)
+
+    if args.salva_baseline:
+        with open(args.baseline, 'w') as f:
+            json.dump({**baseline, **resultados}, f, indent=2)
+        print(f"\nBaseline salvo em {args.baseline}")
+    sys.exit(1 if regressoes else 0)
+
+
+if __name__ == "__main__":
+    main()
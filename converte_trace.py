@@ -0,0 +1,75 @@
+import gzip, os, struct, sys
+
+# Converte o trace multiplexado do lab2 (-tcp.bin[.gz] com traceFormat=binary,
+# ou -tcp.data com "tempo fluxo metrica valor") de volta para os arquivos .data
+# por fluxo ("tempo valor"), no mesmo layout dos tracers antigos.
+#
+# Uso: python3 converte_trace.py <arquivo -tcp.bin[.gz] ou -tcp.data> [prefixo_saida]
+
+MAGIC = b"TCPTRC01"
+REGISTRO = struct.Struct("<qIHHd")  # timeNs, node, flow, metric, value (TraceRecord)
+METRICAS = ["cwnd", "ssth", "rtt", "rto", "next-tx", "inflight", "next-rx"]
+METRICAS_INTEIRAS = {"cwnd", "ssth", "next-tx", "inflight", "next-rx"}
+AGREGADOS = ["", "-min", "-max"]  # byte alto de metric (traceMode=bucket)
+
+
+def abre_trace(caminho):
+    if caminho.endswith(".gz"):
+        return gzip.open(caminho, "rb")
+    return open(caminho, "rb")
+
+
+def le_registros(caminho):
+    with abre_trace(caminho) as f:
+        if f.read(len(MAGIC)) != MAGIC:
+            raise ValueError(f"{caminho} não é um trace binário do lab2")
+        while True:
+            bloco = f.read(REGISTRO.size * 65536)
+            if not bloco:
+                break
+            usados = len(bloco) - len(bloco) % REGISTRO.size
+            for tempo_ns, no, fluxo, metrica, valor in REGISTRO.iter_unpack(bloco[:usados]):
+                tempo = "0.0" if tempo_ns == 0 else "%g" % (tempo_ns / 1e9)
+                base = METRICAS[metrica & 0xff]
+                yield tempo, fluxo, base + AGREGADOS[metrica >> 8], formata_valor(base, valor)
+
+
+def le_texto(caminho):
+    with open(caminho) as f:
+        for linha in f:
+            tempo, fluxo, metrica, valor = linha.split()
+            yield tempo, int(fluxo), metrica, valor
+
+
+def formata_valor(metrica, valor):
+    if metrica in METRICAS_INTEIRAS:
+        return str(int(valor))
+    return f"{valor:g}"
+
+
+def converte(caminho, prefixo):
+    leitor = le_texto if caminho.endswith(".data") else le_registros
+    grupos = {}
+    for tempo, fluxo, metrica, valor in leitor(caminho):
+        grupos.setdefault((metrica, fluxo), []).append(f"{tempo} {valor}\n")
+
+    varios_fluxos = len({fluxo for _, fluxo in grupos}) > 1
+    arquivos = []
+    for (metrica, fluxo), linhas in grupos.items():
+        sufixo = f"-flow{fluxo}" if varios_fluxos else ""
+        saida = f"{prefixo}{sufixo}-{metrica}.data"
+        with open(saida, "w") as f:
+            f.writelines(linhas)
+        arquivos.append(saida)
+    return arquivos
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print("Uso: python3 converte_trace.py <arquivo -tcp.bin[.gz] ou -tcp.data> [prefixo_saida]")
+        sys.exit(1)
+    entrada = sys.argv[1]
+    base = entrada[:-3] if entrada.endswith(".gz") else entrada
+    prefixo = sys.argv[2] if len(sys.argv) > 2 else base.replace("-tcp.bin", "").replace("-tcp.data", "")
+    for arq in converte(entrada, prefixo):
+        print(f"Gerado: {arq}")
@@ -0,0 +1,157 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/**
+ * Code shared by every lab program: the wall-clock phase profiler (profile
+ * option), the event scheduler selection (scheduler option) and the resident
+ * memory probe.
+ */
+
+#ifndef LAB_COMMON_H
+#define LAB_COMMON_H
+
+#include "ns3/core-module.h"
+
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace ns3;
+
+/**
+ * Opt-in wall-clock profiler of the phases of a run (profile option).
+ *
+ * Mark() closes the phase that ran since the previous mark (or since
+ * Start()), so the phases add up to the whole run.
+ */
+class PhaseProfiler
+{
+  public:
+    /**
+     * Start timing; does nothing unless enabled.
+     *
+     * @param enabled Whether to profile this run.
+     */
+    void Start(bool enabled)
+    {
+        m_enabled = enabled;
+        m_phases.clear();
+        m_last = std::chrono::steady_clock::now();
+    }
+
+    /**
+     * @return true if this run is profiled.
+     */
+    bool IsEnabled() const
+    {
+        return m_enabled;
+    }
+
+    /**
+     * Close the current phase.
+     *
+     * @param phase Name of the phase that just finished.
+     */
+    void Mark(const char* phase)
+    {
+        if (!m_enabled)
+        {
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        m_phases.emplace_back(phase, std::chrono::duration<double>(now - m_last).count());
+        m_last = now;
+    }
+
+    /**
+     * @return wall-clock time of each phase, in seconds, in order.
+     */
+    const std::vector<std::pair<const char*, double>>& Phases() const
+    {
+        return m_phases;
+    }
+
+    /**
+     * Print the one-line summary followed by one line per phase.
+     *
+     * @param os Output stream.
+     * @param simulatedSeconds Simulated time reached.
+     * @param events Events executed.
+     */
+    void Report(std::ostream& os, double simulatedSeconds, uint64_t events) const
+    {
+        if (!m_enabled)
+        {
+            return;
+        }
+        double total = 0;
+        double run = 0;
+        for (const auto& [phase, seconds] : m_phases)
+        {
+            total += seconds;
+            run += std::string(phase) == "run" ? seconds : 0;
+        }
+        os << "profile: " << total << " s wall | run " << run << " s | " << events
+           << " events | " << (run > 0 ? simulatedSeconds / run : 0) << " sim-s/wall-s | "
+           << (run > 0 ? events / run : 0) << " events/s" << std::endl;
+        for (const auto& [phase, seconds] : m_phases)
+        {
+            os << "profile-phase: " << phase << " " << seconds << " s ("
+               << (total > 0 ? 100 * seconds / total : 0) << "%)" << std::endl;
+        }
+    }
+
+  private:
+    bool m_enabled{false};                                //!< Profiling this run.
+    std::chrono::steady_clock::time_point m_last;         //!< End of the previous phase.
+    std::vector<std::pair<const char*, double>> m_phases; //!< Wall-clock time of each phase.
+};
+
+static PhaseProfiler profiler; //!< Phase profiler (profile option).
+
+/**
+ * Select the event scheduler of the simulator (scheduler option).
+ *
+ * @param name map, list, heap, calendar or priority.
+ */
+static void
+SelectScheduler(const std::string& name)
+{
+    static const std::map<std::string, std::string> types = {
+        {"map", "ns3::MapScheduler"},
+        {"list", "ns3::ListScheduler"},
+        {"heap", "ns3::HeapScheduler"},
+        {"calendar", "ns3::CalendarScheduler"},
+        {"priority", "ns3::PriorityQueueScheduler"},
+    };
+    auto it = types.find(name);
+    if (it == types.end())
+    {
+        NS_FATAL_ERROR("scheduler precisa ser map, list, heap, calendar ou priority.");
+    }
+    ObjectFactory factory;
+    factory.SetTypeId(it->second);
+    Simulator::SetScheduler(factory);
+}
+
+/**
+ * @return resident memory of this process, in bytes.
+ */
+inline uint64_t
+ResidentBytes()
+{
+    uint64_t pages = 0;
+    uint64_t resident = 0;
+    std::ifstream statm("/proc/self/statm");
+    statm >> pages >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+#endif /* LAB_COMMON_H */
@@ -0,0 +1,426 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/**
+ * Background pcap capture (pcapAsync option) shared by the programs that
+ * offer it.
+ */
+
+#ifndef LAB_PCAP_H
+#define LAB_PCAP_H
+
+#include "ns3/core-module.h"
+#include "ns3/csma-module.h"
+#include "ns3/network-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/wifi-net-device.h"
+#include "ns3/wifi-phy.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace ns3;
+
+/**
+ * Pcap capture that keeps only the first bytes of each packet and writes
+ * them from a background thread (pcapAsync option).
+ *
+ * The sniffer callbacks only append a record to the in-memory block of their
+ * stream; full blocks go through a bounded queue to the writer thread, which
+ * owns every file. A stream moves to a new file when the current one would
+ * exceed the size limit or has covered the time limit of simulated time, and
+ * only its newest files are kept.
+ */
+class AsyncPcapWriter
+{
+  public:
+    /**
+     * Start the writer thread.
+     *
+     * @param snaplen Bytes kept of each packet.
+     * @param rotateBytes File size to rotate at (0 = no limit).
+     * @param rotateTime Simulated time per file (0 = no limit).
+     * @param maxFiles Files kept per stream (0 = all).
+     */
+    void Start(uint32_t snaplen, uint64_t rotateBytes, Time rotateTime, uint32_t maxFiles)
+    {
+        m_snaplen = snaplen;
+        m_rotateBytes = rotateBytes;
+        m_rotateTime = rotateTime;
+        m_maxFiles = maxFiles;
+        m_records = 0;
+        m_bytes = 0;
+        m_files = 0;
+        m_stalls = 0;
+        m_stopping = false;
+        m_enabled = true;
+        m_thread = std::thread(&AsyncPcapWriter::WriterLoop, this);
+    }
+
+    /**
+     * @return true if Start was called.
+     */
+    bool IsEnabled() const
+    {
+        return m_enabled;
+    }
+
+    /**
+     * Capture the packets a device sees.
+     *
+     * p2p and CSMA devices are captured at their PromiscSniffer trace, wifi
+     * devices at the monitor sniffers of their PHY (802.11 frames, no radiotap
+     * header).
+     *
+     * @param prefix File name prefix; the device adds "-<node>-<device>".
+     * @param device The device.
+     */
+    void Add(const std::string& prefix, Ptr<NetDevice> device);
+
+    /**
+     * Append one packet to a stream.
+     *
+     * @param stream The stream.
+     * @param packet The packet, starting at the link header.
+     */
+    void Record(uint32_t stream, Ptr<const Packet> packet);
+
+    /**
+     * Hand every pending block to the writer and wait for it to finish.
+     */
+    void Stop();
+
+    /**
+     * Print the capture totals.
+     *
+     * @param os Output stream.
+     */
+    void Report(std::ostream& os) const
+    {
+        os << "pcap: " << m_records << " records | " << m_bytes << " bytes in " << m_files
+           << " files | snaplen " << m_snaplen << " | " << m_stalls << " writer stalls"
+           << std::endl;
+    }
+
+  private:
+    static constexpr uint32_t PCAP_GLOBAL_HEADER = 24; //!< Bytes of the pcap file header.
+    static constexpr uint32_t PCAP_RECORD_HEADER = 16; //!< Bytes of a pcap record header.
+    static constexpr size_t BLOCK_BYTES = 256 * 1024;  //!< Block handed to the writer.
+    static constexpr size_t MAX_QUEUED = 64;           //!< Blocks queued before Flush waits.
+
+    /**
+     * Capture state of one device, owned by the simulation thread.
+     */
+    struct Stream
+    {
+        std::string base;           //!< File name without extension.
+        uint32_t linkType{0};       //!< Pcap link type.
+        uint32_t file{0};           //!< Index of the current file.
+        uint64_t fileBytes{0};      //!< Bytes in the current file.
+        Time fileStart;             //!< Simulated time the current file started.
+        std::vector<uint8_t> block; //!< Records not handed to the writer yet.
+        std::string openFile;       //!< File the next block starts, if any.
+        std::string removeFile;     //!< File rotated out with the next block, if any.
+    };
+
+    /**
+     * Work item of the writer thread.
+     */
+    struct Block
+    {
+        uint32_t stream{0};        //!< The stream.
+        uint32_t linkType{0};      //!< Pcap link type of a new file.
+        std::string openFile;      //!< Close the current file and open this one first.
+        std::string removeFile;    //!< Delete this file after opening.
+        std::vector<uint8_t> data; //!< Records.
+    };
+
+    /**
+     * @param base File name without extension.
+     * @param file File index.
+     * @return name of the file.
+     */
+    static std::string FileName(const std::string& base, uint32_t file)
+    {
+        return file ? base + "." + std::to_string(file) + ".pcap" : base + ".pcap";
+    }
+
+    /**
+     * Queue the block of a stream, waiting while the queue is full.
+     *
+     * @param stream The stream.
+     */
+    void Flush(uint32_t stream);
+
+    /**
+     * Body of the writer thread.
+     */
+    void WriterLoop();
+
+    std::vector<Stream> m_streams;   //!< Streams, by index.
+    uint32_t m_snaplen{0};           //!< Bytes kept of each packet.
+    uint64_t m_rotateBytes{0};       //!< File size to rotate at.
+    Time m_rotateTime;               //!< Simulated time per file.
+    uint32_t m_maxFiles{0};          //!< Files kept per stream.
+    uint64_t m_records{0};           //!< Records captured.
+    uint64_t m_bytes{0};             //!< Bytes written, headers included.
+    uint64_t m_files{0};             //!< Files opened.
+    uint64_t m_stalls{0};            //!< Times the simulation waited for the writer.
+    bool m_enabled{false};           //!< Start was called.
+    std::deque<Block> m_queue;       //!< Blocks waiting for the writer.
+    bool m_stopping{false};          //!< No more blocks will be queued.
+    std::mutex m_mutex;              //!< Guards the queue and m_stopping.
+    std::condition_variable m_ready; //!< Signals the writer.
+    std::condition_variable m_space; //!< Signals the simulation.
+    std::thread m_thread;            //!< Writer thread.
+};
+
+static AsyncPcapWriter pcapWriter; //!< Background pcap capture (pcapAsync option).
+
+/**
+ * Sniffer trace of a p2p or CSMA device.
+ *
+ * @param stream Capture stream of the device.
+ * @param packet The packet.
+ */
+static void
+PcapSniff(uint32_t stream, Ptr<const Packet> packet)
+{
+    pcapWriter.Record(stream, packet);
+}
+
+/**
+ * MonitorSnifferRx trace of a wifi PHY.
+ *
+ * @param stream Capture stream of the device.
+ * @param packet The frame.
+ * @param channelFreqMhz Channel frequency.
+ * @param txVector TX vector of the frame.
+ * @param aMpdu A-MPDU information.
+ * @param signalNoise Signal and noise power.
+ * @param staId STA-ID.
+ */
+static void
+PcapSniffWifiRx(uint32_t stream,
+                Ptr<const Packet> packet,
+                uint16_t channelFreqMhz [[maybe_unused]],
+                WifiTxVector txVector [[maybe_unused]],
+                MpduInfo aMpdu [[maybe_unused]],
+                SignalNoiseDbm signalNoise [[maybe_unused]],
+                uint16_t staId [[maybe_unused]])
+{
+    pcapWriter.Record(stream, packet);
+}
+
+/**
+ * MonitorSnifferTx trace of a wifi PHY.
+ *
+ * @param stream Capture stream of the device.
+ * @param packet The frame.
+ * @param channelFreqMhz Channel frequency.
+ * @param txVector TX vector of the frame.
+ * @param aMpdu A-MPDU information.
+ * @param staId STA-ID.
+ */
+static void
+PcapSniffWifiTx(uint32_t stream,
+                Ptr<const Packet> packet,
+                uint16_t channelFreqMhz [[maybe_unused]],
+                WifiTxVector txVector [[maybe_unused]],
+                MpduInfo aMpdu [[maybe_unused]],
+                uint16_t staId [[maybe_unused]])
+{
+    pcapWriter.Record(stream, packet);
+}
+
+inline void
+AsyncPcapWriter::Add(const std::string& prefix, Ptr<NetDevice> device)
+{
+    uint32_t stream = m_streams.size();
+    Stream s;
+    s.base = prefix + "-" + std::to_string(device->GetNode()->GetId()) + "-" +
+             std::to_string(device->GetIfIndex());
+    s.fileBytes = PCAP_GLOBAL_HEADER;
+    s.fileStart = Simulator::Now();
+    s.openFile = FileName(s.base, 0);
+    if (DynamicCast<PointToPointNetDevice>(device))
+    {
+        s.linkType = PcapHelper::DLT_PPP;
+        device->TraceConnectWithoutContext("PromiscSniffer", MakeBoundCallback(&PcapSniff, stream));
+    }
+    else if (DynamicCast<CsmaNetDevice>(device))
+    {
+        s.linkType = PcapHelper::DLT_EN10MB;
+        device->TraceConnectWithoutContext("PromiscSniffer", MakeBoundCallback(&PcapSniff, stream));
+    }
+    else if (Ptr<WifiNetDevice> wifi = DynamicCast<WifiNetDevice>(device))
+    {
+        s.linkType = PcapHelper::DLT_IEEE802_11;
+        wifi->GetPhy()->TraceConnectWithoutContext("MonitorSnifferRx",
+                                                   MakeBoundCallback(&PcapSniffWifiRx, stream));
+        wifi->GetPhy()->TraceConnectWithoutContext("MonitorSnifferTx",
+                                                   MakeBoundCallback(&PcapSniffWifiTx, stream));
+    }
+    else
+    {
+        NS_FATAL_ERROR("pcapAsync nao suporta o dispositivo "
+                       << device->GetInstanceTypeId().GetName());
+    }
+    m_streams.push_back(std::move(s));
+}
+
+inline void
+AsyncPcapWriter::Record(uint32_t stream, Ptr<const Packet> packet)
+{
+    Stream& s = m_streams[stream];
+    uint32_t length = packet->GetSize();
+    uint32_t captured = std::min(length, m_snaplen);
+    Time now = Simulator::Now();
+    bool full = m_rotateBytes && s.fileBytes + PCAP_RECORD_HEADER + captured > m_rotateBytes;
+    bool old = m_rotateTime.IsStrictlyPositive() && now - s.fileStart >= m_rotateTime;
+    if ((full || old) && s.fileBytes > PCAP_GLOBAL_HEADER)
+    {
+        Flush(stream);
+        s.file++;
+        s.fileBytes = PCAP_GLOBAL_HEADER;
+        s.fileStart = now;
+        s.openFile = FileName(s.base, s.file);
+        if (m_maxFiles && s.file >= m_maxFiles)
+        {
+            s.removeFile = FileName(s.base, s.file - m_maxFiles);
+        }
+    }
+
+    // Cabecalho do registro: segundos, microssegundos, bytes gravados, tamanho original
+    int64_t us = now.GetMicroSeconds();
+    uint32_t header[4] = {static_cast<uint32_t>(us / 1000000),
+                          static_cast<uint32_t>(us % 1000000),
+                          captured,
+                          length};
+    size_t offset = s.block.size();
+    s.block.resize(offset + sizeof(header) + captured);
+    std::memcpy(&s.block[offset], header, sizeof(header));
+    packet->CopyData(&s.block[offset + sizeof(header)], captured);
+    s.fileBytes += sizeof(header) + captured;
+    m_records++;
+    if (s.block.size() >= BLOCK_BYTES)
+    {
+        Flush(stream);
+    }
+}
+
+inline void
+AsyncPcapWriter::Flush(uint32_t stream)
+{
+    Stream& s = m_streams[stream];
+    if (s.block.empty() && s.openFile.empty())
+    {
+        return;
+    }
+    Block block;
+    block.stream = stream;
+    block.linkType = s.linkType;
+    block.openFile.swap(s.openFile);
+    block.removeFile.swap(s.removeFile);
+    block.data.swap(s.block);
+    s.block.reserve(BLOCK_BYTES);
+    m_bytes += block.data.size() + (block.openFile.empty() ? 0 : PCAP_GLOBAL_HEADER);
+    m_files += !block.openFile.empty();
+
+    std::unique_lock lock(m_mutex);
+    if (m_queue.size() >= MAX_QUEUED)
+    {
+        m_stalls++;
+        m_space.wait(lock, [this] { return m_queue.size() < MAX_QUEUED; });
+    }
+    m_queue.push_back(std::move(block));
+    lock.unlock();
+    m_ready.notify_one();
+}
+
+inline void
+AsyncPcapWriter::Stop()
+{
+    for (uint32_t stream = 0; stream < m_streams.size(); ++stream)
+    {
+        Flush(stream);
+    }
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+    }
+    m_ready.notify_one();
+    m_thread.join();
+    m_streams.clear();
+    m_enabled = false;
+}
+
+inline void
+AsyncPcapWriter::WriterLoop()
+{
+    std::map<uint32_t, FILE*> files;
+    std::unique_lock lock(m_mutex);
+    while (true)
+    {
+        m_ready.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+        if (m_queue.empty())
+        {
+            break;
+        }
+        Block block = std::move(m_queue.front());
+        m_queue.pop_front();
+        lock.unlock();
+        m_space.notify_one();
+
+        FILE*& file = files[block.stream];
+        if (!block.openFile.empty())
+        {
+            if (file)
+            {
+                std::fclose(file);
+            }
+            file = std::fopen(block.openFile.c_str(), "wb");
+            if (!file)
+            {
+                NS_FATAL_ERROR("Nao foi possivel abrir " << block.openFile);
+            }
+            struct
+            {
+                uint32_t magic;
+                uint16_t major;
+                uint16_t minor;
+                int32_t zone;
+                uint32_t sigfigs;
+                uint32_t snaplen;
+                uint32_t linkType;
+            } header{0xa1b2c3d4, 2, 4, 0, 0, m_snaplen, block.linkType};
+            std::fwrite(&header, sizeof(header), 1, file);
+            if (!block.removeFile.empty())
+            {
+                std::remove(block.removeFile.c_str());
+            }
+        }
+        std::fwrite(block.data.data(), 1, block.data.size(), file);
+        lock.lock();
+    }
+    for (auto& [stream, file] : files)
+    {
+        if (file)
+        {
+            std::fclose(file);
+        }
+    }
+}
+
+#endif /* LAB_PCAP_H */
@@ -0,0 +1,312 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/**
+ * Echo round-trip time histograms (rtt option) shared by the lab1 programs.
+ */
+
+#ifndef LAB_RTT_H
+#define LAB_RTT_H
+
+#include "ns3/applications-module.h"
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace ns3;
+
+/**
+ * Log-bucketed (HDR-style) histogram of round-trip times, in microseconds.
+ *
+ * Values below SUB_BUCKETS are kept exactly; above that every power of two is
+ * split into SUB_BUCKETS linear buckets, so the relative error stays below
+ * 1/SUB_BUCKETS over the whole range. Buckets are allocated up to the largest
+ * value seen.
+ */
+class RttHistogram
+{
+  public:
+    /**
+     * Record one value.
+     *
+     * @param us The value, in microseconds.
+     */
+    void Add(uint64_t us)
+    {
+        uint32_t index = Index(us);
+        if (index >= m_counts.size())
+        {
+            m_counts.resize(index + 1, 0);
+        }
+        m_counts[index]++;
+        m_count++;
+        m_max = std::max(m_max, us);
+    }
+
+    /**
+     * Add the values of another histogram.
+     *
+     * @param other The histogram.
+     */
+    void Merge(const RttHistogram& other)
+    {
+        if (other.m_counts.size() > m_counts.size())
+        {
+            m_counts.resize(other.m_counts.size(), 0);
+        }
+        for (size_t i = 0; i < other.m_counts.size(); ++i)
+        {
+            m_counts[i] += other.m_counts[i];
+        }
+        m_count += other.m_count;
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    /**
+     * @return number of values recorded.
+     */
+    uint64_t Count() const
+    {
+        return m_count;
+    }
+
+    /**
+     * @param percent Percentile, in percent.
+     * @return value at the percentile, in microseconds (0 if empty).
+     */
+    double Percentile(double percent) const
+    {
+        uint64_t target = std::max<uint64_t>(std::ceil(percent / 100 * m_count), 1);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < m_counts.size(); ++i)
+        {
+            seen += m_counts[i];
+            if (seen >= target)
+            {
+                return Value(i);
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * @return largest value recorded, in microseconds.
+     */
+    uint64_t Max() const
+    {
+        return m_max;
+    }
+
+  private:
+    static constexpr uint32_t SUB_BITS = 5;                //!< log2 of SUB_BUCKETS.
+    static constexpr uint32_t SUB_BUCKETS = 1 << SUB_BITS; //!< Buckets per power of two.
+
+    /**
+     * @param us A value, in microseconds.
+     * @return the bucket of the value.
+     */
+    static uint32_t Index(uint64_t us)
+    {
+        if (us < SUB_BUCKETS)
+        {
+            return us;
+        }
+        // us >> shift fica em [SUB_BUCKETS, 2 * SUB_BUCKETS)
+        uint32_t shift = std::bit_width(us) - 1 - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + (us >> shift) - SUB_BUCKETS;
+    }
+
+    /**
+     * @param index A bucket.
+     * @return middle of the bucket, in microseconds.
+     */
+    static double Value(uint32_t index)
+    {
+        uint32_t shift = index / SUB_BUCKETS;
+        if (shift == 0)
+        {
+            return index;
+        }
+        uint64_t width = uint64_t{1} << (shift - 1);
+        return ((SUB_BUCKETS + index % SUB_BUCKETS) * width) + (width - 1) / 2.0;
+    }
+
+    std::vector<uint32_t> m_counts; //!< Values in each bucket.
+    uint64_t m_count{0};            //!< Values recorded.
+    uint64_t m_max{0};              //!< Largest value recorded.
+};
+
+/**
+ * Round-trip times of the echo clients (rtt option).
+ *
+ * Each request is matched to its reply by packet UID, which the echo server
+ * keeps, and the RTT goes to the histogram of the client and to the global
+ * one. Requests still unanswered at the end count as lost.
+ */
+class EchoRttMonitor
+{
+  public:
+    /**
+     * Connect to the Tx and Rx traces of the echo clients.
+     *
+     * @param clients The echo client applications.
+     */
+    void Start(const ApplicationContainer& clients);
+
+    /**
+     * Account a request.
+     *
+     * @param client The client.
+     * @param packet The request.
+     */
+    void Tx(uint32_t client, Ptr<const Packet> packet)
+    {
+        m_clients[client].pending[packet->GetUid()] = Simulator::Now().GetMicroSeconds();
+        m_clients[client].sent++;
+    }
+
+    /**
+     * Account a reply.
+     *
+     * @param client The client.
+     * @param packet The reply.
+     */
+    void Rx(uint32_t client, Ptr<const Packet> packet)
+    {
+        Client& c = m_clients[client];
+        auto it = c.pending.find(packet->GetUid());
+        if (it == c.pending.end())
+        {
+            return;
+        }
+        uint64_t rtt = Simulator::Now().GetMicroSeconds() - it->second;
+        c.pending.erase(it);
+        c.histogram.Add(rtt);
+        m_global.Add(rtt);
+    }
+
+    /**
+     * Print the global percentiles and loss, then those of each client, to
+     * the stream or, with many clients, to a CSV file.
+     *
+     * @param os Output stream.
+     * @param clientFile CSV file of the per-client lines.
+     */
+    void Report(std::ostream& os, const std::string& clientFile) const;
+
+  private:
+    /**
+     * Measurements of one client.
+     */
+    struct Client
+    {
+        std::unordered_map<uint64_t, int64_t> pending; //!< Send time of open requests, by UID.
+        RttHistogram histogram;                        //!< RTTs of the client.
+        uint32_t sent{0};                              //!< Requests sent.
+    };
+
+    /**
+     * Write "sent,received,loss,p50,p90,p99,p99.9,max" (RTTs in ms).
+     *
+     * @param os Output stream.
+     * @param sent Requests sent.
+     * @param histogram RTTs.
+     */
+    static void WriteRow(std::ostream& os, uint64_t sent, const RttHistogram& histogram);
+
+    std::vector<Client> m_clients; //!< Per-client measurements.
+    RttHistogram m_global;         //!< RTTs of every client.
+};
+
+static EchoRttMonitor rttMonitor; //!< Echo RTT histograms (rtt option).
+
+/**
+ * Tx trace of an echo client.
+ *
+ * @param client The client.
+ * @param packet The request.
+ */
+static void
+EchoRttTx(uint32_t client, Ptr<const Packet> packet)
+{
+    rttMonitor.Tx(client, packet);
+}
+
+/**
+ * Rx trace of an echo client.
+ *
+ * @param client The client.
+ * @param packet The reply.
+ */
+static void
+EchoRttRx(uint32_t client, Ptr<const Packet> packet)
+{
+    rttMonitor.Rx(client, packet);
+}
+
+inline void
+EchoRttMonitor::Start(const ApplicationContainer& clients)
+{
+    m_clients.assign(clients.GetN(), Client());
+    for (uint32_t i = 0; i < clients.GetN(); ++i)
+    {
+        clients.Get(i)->TraceConnectWithoutContext("Tx", MakeBoundCallback(&EchoRttTx, i));
+        clients.Get(i)->TraceConnectWithoutContext("Rx", MakeBoundCallback(&EchoRttRx, i));
+    }
+}
+
+inline void
+EchoRttMonitor::WriteRow(std::ostream& os, uint64_t sent, const RttHistogram& histogram)
+{
+    uint64_t received = histogram.Count();
+    os << sent << "," << received << "," << (sent ? 1.0 - static_cast<double>(received) / sent : 0);
+    for (double percent : {50.0, 90.0, 99.0, 99.9})
+    {
+        os << "," << histogram.Percentile(percent) / 1000;
+    }
+    os << "," << histogram.Max() / 1000.0 << "\n";
+}
+
+inline void
+EchoRttMonitor::Report(std::ostream& os, const std::string& clientFile) const
+{
+    uint64_t sent = 0;
+    for (const Client& c : m_clients)
+    {
+        sent += c.sent;
+    }
+    uint64_t received = m_global.Count();
+    os << "RTT: " << received << " replies of " << sent << " requests | loss "
+       << (sent ? 100.0 * (sent - received) / sent : 0) << "% | p50 "
+       << m_global.Percentile(50) / 1000 << " ms | p90 " << m_global.Percentile(90) / 1000
+       << " ms | p99 " << m_global.Percentile(99) / 1000 << " ms | p99.9 "
+       << m_global.Percentile(99.9) / 1000 << " ms | max " << m_global.Max() / 1000.0 << " ms"
+       << std::endl;
+
+    // Com poucos clientes as linhas vao para a saida; com muitos, para o CSV
+    std::ofstream file;
+    std::ostream* out = &os;
+    if (m_clients.size() > 32)
+    {
+        file.open(clientFile);
+        out = &file;
+        os << "RTT per client: " << clientFile << std::endl;
+    }
+    *out << "client,sent,received,loss,p50_ms,p90_ms,p99_ms,p999_ms,max_ms\n";
+    for (size_t i = 0; i < m_clients.size(); ++i)
+    {
+        *out << i << ",";
+        WriteRow(*out, m_clients[i].sent, m_clients[i].histogram);
+    }
+}
+
+#endif /* LAB_RTT_H */
@@ -2,12 +2,20 @@
  * SPDX-License-Identifier: GPL-2.0-only
  */
 
+#include "lab-common.h"
+#include "lab-rtt.h"
+
 #include "ns3/applications-module.h"
 #include "ns3/core-module.h"
 #include "ns3/internet-module.h"
 #include "ns3/network-module.h"
 #include "ns3/point-to-point-module.h"
 
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
 // Default Network Topology
 //
 //       10.1.1.0
@@ -24,26 +32,57 @@ main(int argc, char* argv[])
 {
     uint32_t nPackets = 1;
     uint32_t nClients = 1;
+    bool profile = false;
+    std::string scheduler = "map";
+    bool verbose = false;
+    bool rtt = true;
+    bool star = false;
 
     CommandLine cmd(__FILE__);
     cmd.AddValue("nClients", "Numero de clientes", nClients);
     cmd.AddValue("nPackets", "Numero de pacotes enviados pelos clientes", nPackets);
+    cmd.AddValue("profile",
+                 "Time each phase of the run and report events/s and simulated seconds per "
+                 "wall second",
+                 profile);
+    cmd.AddValue("scheduler",
+                 "Event scheduler: map, list, heap, calendar or priority",
+                 scheduler);
+    cmd.AddValue("verbose", "Log every echo request and reply", verbose);
+    cmd.AddValue("rtt", "Report echo RTT percentiles and loss per client and overall", rtt);
+    cmd.AddValue("star",
+                 "Large star: no cap on nClients, one /30 per link and no global routing; "
+                 "reports build time and memory per client",
+                 star);
 
     cmd.Parse(argc, argv);
+    profiler.Start(profile);
+    SelectScheduler(scheduler);
 
     // Filtro
     if (nPackets < 0 || nPackets > 5)
     {
         nPackets = 1;
     }
-    if (nClients < 0 || nClients > 5){
+    // Uma /30 por enlace: 2^22 enlaces cabem em 10.0.0.0/8
+    if (star && (nClients < 1 || nClients > (1u << 22)))
+    {
+        NS_FATAL_ERROR("Com star, nClients precisa estar entre 1 e " << (1u << 22) << ".");
+    }
+    if (!star && (nClients < 0 || nClients > 5)){
         nClients = 1;
     }
 
+    auto buildStart = std::chrono::steady_clock::now();
+    uint64_t buildResident = ResidentBytes();
 
     Time::SetResolution(Time::NS);
-    LogComponentEnable("UdpEchoClientApplication", LOG_LEVEL_INFO);
-    LogComponentEnable("UdpEchoServerApplication", LOG_LEVEL_INFO);
+    // Com muitos clientes o log de cada eco domina a execucao
+    if (verbose)
+    {
+        LogComponentEnable("UdpEchoClientApplication", LOG_LEVEL_INFO);
+        LogComponentEnable("UdpEchoServerApplication", LOG_LEVEL_INFO);
+    }
 
     NodeContainer server;
     server.Create(1);
@@ -59,22 +98,39 @@ main(int argc, char* argv[])
     pointToPoint.SetDeviceAttribute("DataRate", StringValue("5Mbps"));
     pointToPoint.SetChannelAttribute("Delay", StringValue("2ms"));
 
+    profiler.Mark("topology");
     InternetStackHelper stack;
     stack.Install(nodes);
+    profiler.Mark("stack");
 
     Ipv4AddressHelper address;
-    address.SetBase("10.1.1.0", "255.255.255.0");
+    if (star)
+    {
+        address.SetBase("10.0.0.0", "255.255.255.252");
+    }
+    else
+    {
+        address.SetBase("10.1.1.0", "255.255.255.0");
+    }
 
-    Ipv4InterfaceContainer interfaces;
+    // Endereco do servidor no enlace de cada cliente
+    std::vector<Ipv4Address> serverAddress(nClients);
     NetDeviceContainer devices;
 
     for (uint32_t i=0; i < nClients; i++){
         devices = pointToPoint.Install(server.Get(0), clients.Get(i));
-        interfaces = address.Assign(devices);
+        serverAddress[i] = address.Assign(devices).GetAddress(0);
         address.NewNetwork();
     }
 
-    Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+    profiler.Mark("links");
+    // Cada cliente so fala com o servidor pelo proprio enlace, que e rota
+    // direta dos dois lados
+    if (!star)
+    {
+        Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+    }
+    profiler.Mark("routing");
 
     UdpEchoServerHelper echoServer(9);
     echoServer.SetAttribute("Port", UintegerValue(15));
@@ -83,21 +139,48 @@ main(int argc, char* argv[])
     serverApps.Start(Seconds(1));
     serverApps.Stop(Seconds(20));
 
-    UdpEchoClientHelper echoClient(interfaces.GetAddress(0), 15);
+    UdpEchoClientHelper echoClient(serverAddress[0], 15);
     echoClient.SetAttribute("MaxPackets", UintegerValue(nPackets));
     echoClient.SetAttribute("Interval", TimeValue(Seconds(2)));
     echoClient.SetAttribute("PacketSize", UintegerValue(1024));
 
+    ApplicationContainer allClientApps;
+    Ptr<UniformRandomVariable> x = CreateObject<UniformRandomVariable>();
     for (uint32_t i=0; i<nClients; i++ ){
-        Ptr<UniformRandomVariable> x = CreateObject<UniformRandomVariable>();
         uint32_t rand_n = x->GetInteger() % 5 + 2; // Gerando numero entre 7 e 2
 
+        echoClient.SetAttribute("RemoteAddress", AddressValue(serverAddress[i]));
         ApplicationContainer clientApps = echoClient.Install(clients.Get(i));
         clientApps.Start(Seconds(rand_n));
         clientApps.Stop(Seconds(20));
+        allClientApps.Add(clientApps);
+    }
+    if (rtt)
+    {
+        rttMonitor.Start(allClientApps);
     }
     
+    profiler.Mark("apps");
+    if (star)
+    {
+        double buildSeconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count();
+        uint64_t resident = ResidentBytes();
+        double bytesPerClient =
+            resident > buildResident ? static_cast<double>(resident - buildResident) / nClients : 0;
+        std::cout << "Star: " << nClients << " clients | build " << buildSeconds << " s | "
+                  << bytesPerClient << " bytes/client" << std::endl;
+    }
     Simulator::Run();
+    profiler.Mark("run");
+    if (rtt)
+    {
+        rttMonitor.Report(std::cout, "lab1-part1-rtt.csv");
+    }
+    uint64_t events = Simulator::GetEventCount();
+    double simulatedSeconds = Simulator::Now().GetSeconds();
     Simulator::Destroy();
+    profiler.Mark("teardown");
+    profiler.Report(std::cout, simulatedSeconds, events);
     return 0;
 }
@@ -2,7 +2,12 @@
  * SPDX-License-Identifier: GPL-2.0-only
  */
 
+#include "lab-common.h"
+#include "lab-pcap.h"
+#include "lab-rtt.h"
+
 #include "ns3/applications-module.h"
+#include "ns3/bridge-module.h"
 #include "ns3/core-module.h"
 #include "ns3/csma-module.h"
 #include "ns3/internet-module.h"
@@ -10,6 +15,9 @@
 #include "ns3/network-module.h"
 #include "ns3/point-to-point-module.h"
 
+#include <iostream>
+#include <string>
+
 // Default Network Topology
 //
 //       10.1.1.0
@@ -17,6 +25,9 @@
 //    point-to-point  |    |    |    |
 //                    ================
 //                      LAN 10.1.2.0
+//
+// With lan=switch the LAN is a star instead: every LAN node has its own
+// CSMA link to a bridge node that forwards frames by learned MAC address.
 
 using namespace ns3;
 
@@ -27,24 +38,87 @@ main(int argc, char* argv[])
 {
     uint32_t nCsma = 3;
     uint32_t nPackets = 1;
+    bool profile = false;
+    std::string scheduler = "map";
+    bool verbose = false;
+    bool rtt = true;
+    bool pcapAsync = false;
+    uint32_t pcapSnaplen = 128;
+    uint64_t pcapRotateBytes = 0;
+    Time pcapRotateTime = Seconds(0);
+    uint32_t pcapMaxFiles = 0;
+    std::string lan = "csma";
+    std::string lanRate = "100Mbps";
+    Time lanDelay = NanoSeconds(6560);
+    std::string portQueue = "100p";
+    bool lanClients = false;
+    bool lanServer = false;
 
     CommandLine cmd(__FILE__);
     cmd.AddValue("nCsma", "Number of \"extra\" CSMA nodes/devices", nCsma);
     cmd.AddValue("nPackets", "Tell echo applications to log if true", nPackets);
+    cmd.AddValue("profile",
+                 "Time each phase of the run and report events/s and simulated seconds per "
+                 "wall second",
+                 profile);
+    cmd.AddValue("scheduler",
+                 "Event scheduler: map, list, heap, calendar or priority",
+                 scheduler);
+    cmd.AddValue("verbose", "Log every echo request and reply", verbose);
+    cmd.AddValue("rtt", "Report echo RTT percentiles and loss per client and overall", rtt);
+    cmd.AddValue("pcapAsync",
+                 "Capture pcap from a background writer thread, keeping pcapSnaplen bytes "
+                 "of each packet",
+                 pcapAsync);
+    cmd.AddValue("pcapSnaplen", "Bytes kept of each packet (pcapAsync)", pcapSnaplen);
+    cmd.AddValue("pcapRotateBytes",
+                 "Pcap file size to rotate at, 0 = no limit (pcapAsync)",
+                 pcapRotateBytes);
+    cmd.AddValue("pcapRotateTime",
+                 "Simulated time per pcap file, 0 = no limit (pcapAsync)",
+                 pcapRotateTime);
+    cmd.AddValue("pcapMaxFiles",
+                 "Pcap files kept per device, 0 = all (pcapAsync)",
+                 pcapMaxFiles);
+    cmd.AddValue("lan",
+                 "LAN segment: csma (one shared channel) or switch (a bridge with one link per "
+                 "node)",
+                 lan);
+    cmd.AddValue("lanRate", "Data rate of the shared channel or of each switch port", lanRate);
+    cmd.AddValue("lanDelay", "Delay of the shared channel or of each switch link", lanDelay);
+    cmd.AddValue("portQueue",
+                 "Transmit queue of each device on the LAN, e.g. 100p (lan=switch)",
+                 portQueue);
+    cmd.AddValue("lanClients",
+                 "Run an echo client on every extra LAN node as well",
+                 lanClients);
+    cmd.AddValue("lanServer",
+                 "Run the echo server on the LAN router of the second point-to-point link, so "
+                 "LAN clients do not cross that link",
+                 lanServer);
 
     cmd.Parse(argc, argv);
+    profiler.Start(profile);
+    SelectScheduler(scheduler);
 
     // Filtro
     if (nPackets < 0 || nPackets > 20)
     {
         nPackets = 1;
     }
-    if (nCsma < 0 || nCsma > 5){
+    if (nCsma < 0 || nCsma > 1000){
         nCsma = 1;
     }
+    if (lan != "csma" && lan != "switch")
+    {
+        NS_FATAL_ERROR("lan precisa ser csma ou switch.");
+    }
 
-    LogComponentEnable("UdpEchoClientApplication", LOG_LEVEL_INFO);
-    LogComponentEnable("UdpEchoServerApplication", LOG_LEVEL_INFO);
+    if (verbose)
+    {
+        LogComponentEnable("UdpEchoClientApplication", LOG_LEVEL_INFO);
+        LogComponentEnable("UdpEchoServerApplication", LOG_LEVEL_INFO);
+    }
 
     NodeContainer p2pNodes;
     p2pNodes.Create(2);
@@ -69,12 +143,32 @@ main(int argc, char* argv[])
 
 
     CsmaHelper csma;
-    csma.SetChannelAttribute("DataRate", StringValue("100Mbps"));
-    csma.SetChannelAttribute("Delay", TimeValue(NanoSeconds(6560)));
+    csma.SetChannelAttribute("DataRate", StringValue(lanRate));
+    csma.SetChannelAttribute("Delay", TimeValue(lanDelay));
 
     NetDeviceContainer csmaDevices;
-    csmaDevices = csma.Install(csmaNodes);
+    if (lan == "csma")
+    {
+        csmaDevices = csma.Install(csmaNodes);
+    }
+    else
+    {
+        // Cada no tem um enlace proprio ate o switch; csmaDevices guarda o
+        // lado dos nos na mesma ordem do modo csma
+        csma.SetQueue("ns3::DropTailQueue<Packet>", "MaxSize", StringValue(portQueue));
+        Ptr<Node> lanSwitch = CreateObject<Node>();
+        NetDeviceContainer switchPorts;
+        for (uint32_t i = 0; i < csmaNodes.GetN(); ++i)
+        {
+            NetDeviceContainer link = csma.Install(NodeContainer(csmaNodes.Get(i), lanSwitch));
+            csmaDevices.Add(link.Get(0));
+            switchPorts.Add(link.Get(1));
+        }
+        BridgeHelper bridge;
+        bridge.Install(lanSwitch, switchPorts);
+    }
 
+    profiler.Mark("topology");
     InternetStackHelper stack;
     stack.Install(p2pNodes.Get(0));
     stack.Install(Sec_p2pNodes.Get(1));
@@ -85,7 +179,15 @@ main(int argc, char* argv[])
     Ipv4InterfaceContainer p2pInterfaces;
     p2pInterfaces = address.Assign(p2pDevices);
 
-    address.SetBase("10.1.2.0", "255.255.255.0");
+    // Uma LAN maior que uma /24 usa 10.2.0.0/16
+    if (csmaNodes.GetN() > 254)
+    {
+        address.SetBase("10.2.0.0", "255.255.0.0");
+    }
+    else
+    {
+        address.SetBase("10.1.2.0", "255.255.255.0");
+    }
     Ipv4InterfaceContainer csmaInterfaces;
     csmaInterfaces = address.Assign(csmaDevices);
     
@@ -93,27 +195,77 @@ main(int argc, char* argv[])
     Ipv4InterfaceContainer Sec_p2pInterfaces;
     Sec_p2pInterfaces = address.Assign(Sec_p2pDevices);
 
+    profiler.Mark("stack");
     UdpEchoServerHelper echoServer(9);
 
-    ApplicationContainer serverApps = echoServer.Install(Sec_p2pNodes.Get(1));
+    // Com lanServer o servidor fica na LAN (csmaNodes 1) e o trafego dos
+    // clientes da LAN nao passa pelo enlace de 5 Mbps ate Sec_p2pNodes 1
+    Ptr<Node> serverNode = lanServer ? csmaNodes.Get(1) : Sec_p2pNodes.Get(1);
+    Ipv4Address serverAddress =
+        lanServer ? csmaInterfaces.GetAddress(1) : Sec_p2pInterfaces.GetAddress(1);
+    ApplicationContainer serverApps = echoServer.Install(serverNode);
     serverApps.Start(Seconds(1));
     serverApps.Stop(Seconds(10));
 
-    UdpEchoClientHelper echoClient(Sec_p2pInterfaces.GetAddress(1), 9);
+    UdpEchoClientHelper echoClient(serverAddress, 9);
     echoClient.SetAttribute("MaxPackets", UintegerValue(nPackets));
     echoClient.SetAttribute("Interval", TimeValue(Seconds(0.1)));
     echoClient.SetAttribute("PacketSize", UintegerValue(1024));
 
     ApplicationContainer clientApps = echoClient.Install(p2pNodes.Get(0));
+    if (lanClients)
+    {
+        // Os nos extras da LAN comecam depois dos dois roteadores
+        for (uint32_t i = 2; i < csmaNodes.GetN(); ++i)
+        {
+            clientApps.Add(echoClient.Install(csmaNodes.Get(i)));
+        }
+    }
     clientApps.Start(Seconds(2));
     clientApps.Stop(Seconds(10));
+    if (rtt)
+    {
+        rttMonitor.Start(clientApps);
+    }
 
+    profiler.Mark("apps");
     Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+    profiler.Mark("routing");
 
-    pointToPoint.EnablePcapAll("second");
-    csma.EnablePcap("second", csmaDevices.Get(1), true);
+    if (pcapAsync)
+    {
+        pcapWriter.Start(pcapSnaplen, pcapRotateBytes, pcapRotateTime, pcapMaxFiles);
+        for (NetDeviceContainer devices : {p2pDevices, Sec_p2pDevices})
+        {
+            for (uint32_t i = 0; i < devices.GetN(); ++i)
+            {
+                pcapWriter.Add("second", devices.Get(i));
+            }
+        }
+        pcapWriter.Add("second", csmaDevices.Get(1));
+    }
+    else
+    {
+        pointToPoint.EnablePcapAll("second");
+        csma.EnablePcap("second", csmaDevices.Get(1), true);
+    }
 
+    profiler.Mark("pcap");
     Simulator::Run();
+    profiler.Mark("run");
+    if (rtt)
+    {
+        rttMonitor.Report(std::cout, "lab1-part2-rtt.csv");
+    }
+    uint64_t events = Simulator::GetEventCount();
+    double simulatedSeconds = Simulator::Now().GetSeconds();
+    if (pcapWriter.IsEnabled())
+    {
+        pcapWriter.Stop();
+        pcapWriter.Report(std::cout);
+    }
     Simulator::Destroy();
+    profiler.Mark("teardown");
+    profiler.Report(std::cout, simulatedSeconds, events);
     return 0;
 }
@@ -2,6 +2,11 @@
  * SPDX-License-Identifier: GPL-2.0-only
  */
 
+#include "lab-common.h"
+#include "lab-pcap.h"
+
+#include "ns3/angles.h"
+#include "ns3/antenna-model.h"
 #include "ns3/applications-module.h"
 #include "ns3/core-module.h"
 #include "ns3/csma-module.h"
@@ -9,9 +14,24 @@
 #include "ns3/mobility-module.h"
 #include "ns3/network-module.h"
 #include "ns3/point-to-point-module.h"
+#include "ns3/propagation-delay-model.h"
+#include "ns3/propagation-loss-model.h"
+#include "ns3/single-model-spectrum-channel.h"
+#include "ns3/spectrum-wifi-helper.h"
 #include "ns3/ssid.h"
+#include "ns3/wifi-phy.h"
 #include "ns3/yans-wifi-helper.h"
 
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
 // Default Network Topology
 //
 //   Wifi 10.1.3.0
@@ -22,190 +42,954 @@
 //                   point-to-point  |    |    |    |
 //                                   ================
 //                                     Wifi 10.1.2.0
+//
+// With nCells > 2 the AP of every further BSS i hangs off n0 by its own
+// point-to-point link 10.2.i.0, and the BSS uses Wifi 10.3.i.0. The echo
+// server stays on the last STA of the 10.1.2.0 BSS and every other BSS has
+// a client.
 
 using namespace ns3;
 
 NS_LOG_COMPONENT_DEFINE("ThirdScriptExample");
 
-int
-main(int argc, char* argv[])
+/**
+ * Spectrum channel that only delivers a transmission to the PHYs within a
+ * cutoff distance of the sender (largeCell option).
+ *
+ * The receivers are indexed in a grid of square cells one cutoff plus a
+ * slack wide, so every receiver within the cutoff lies in the 3x3 cells
+ * around the sender. A receiver is re-indexed when its mobility model
+ * reports a course change; between changes it may drift up to the slack
+ * from its indexed cell. Receivers beyond the cutoff never see the signal,
+ * neither as a frame nor as interference, which is where the results can
+ * differ from SingleModelSpectrumChannel.
+ */
+class GridSpectrumChannel : public SpectrumChannel
 {
-    bool verbose = true;
-    uint32_t nPackets = 3;
-    uint32_t nWifi = 3;
-    bool tracing = false;
-
-    CommandLine cmd(__FILE__);
-    cmd.AddValue("nPackets", "Number of \"extra\" CSMA nodes/devices", nPackets);
-    cmd.AddValue("nWifi", "Number of wifi STA devices", nWifi);
-    cmd.AddValue("verbose", "Tell echo applications to log if true", verbose);
-    cmd.AddValue("tracing", "Enable pcap tracing", tracing);
+  public:
+    /**
+     * Register this type.
+     *
+     * @return The object TypeId.
+     */
+    static TypeId GetTypeId();
+
+    /**
+     * Set the reach of a transmission.
+     *
+     * @param cutoff Reception and interference range, in meters.
+     * @param slack Largest drift of a receiver between course changes, in meters.
+     */
+    void SetRange(double cutoff, double slack);
+
+    void AddRx(Ptr<SpectrumPhy> phy) override;
+    void RemoveRx(Ptr<SpectrumPhy> phy) override;
+    void StartTx(Ptr<SpectrumSignalParameters> params) override;
+    std::size_t GetNDevices() const override;
+    Ptr<NetDevice> GetDevice(std::size_t i) const override;
+
+    /**
+     * Print how many receivers the transmissions reached.
+     *
+     * @param os Output stream.
+     * @param name Name of the channel in the report.
+     */
+    void Report(std::ostream& os, const std::string& name) const;
+
+  private:
+    /**
+     * Key of the grid cell holding a position.
+     *
+     * @param position The position.
+     * @return The cell key.
+     */
+    int64_t CellOf(const Vector& position) const;
+
+    /**
+     * Index every receiver at its current position.
+     */
+    void Index();
+
+    /**
+     * CourseChange trace of the mobility model of a receiver.
+     *
+     * @param mobility The mobility model.
+     */
+    void CourseChanged(Ptr<const MobilityModel> mobility);
+
+    /**
+     * Move a receiver to another cell of the index.
+     *
+     * @param rx Index of the receiver in m_phys.
+     * @param cell The new cell.
+     */
+    void Reindex(uint32_t rx, int64_t cell);
+
+    /**
+     * Schedule the reception of a transmission by one receiver.
+     *
+     * @param txParams Parameters of the transmission.
+     * @param receiver The receiver.
+     */
+    void Deliver(Ptr<SpectrumSignalParameters> txParams, Ptr<SpectrumPhy> receiver);
+
+    std::vector<Ptr<SpectrumPhy>> m_phys;                                 //!< Receivers.
+    std::vector<int64_t> m_cellOf;                                        //!< Cell of receivers.
+    std::unordered_map<int64_t, std::vector<uint32_t>> m_cells;           //!< Receivers by cell.
+    std::vector<uint32_t> m_unplaced;                                     //!< Without mobility.
+    std::unordered_multimap<const MobilityModel*, uint32_t> m_byMobility; //!< Receivers by model.
+    std::unordered_set<const MobilityModel*> m_hooked;                    //!< Models traced.
+
+    double m_cutoff{100};        //!< Reception range, in meters.
+    double m_cellSize{110};      //!< Side of a grid cell, in meters.
+    bool m_indexed{false};       //!< The index is up to date.
+    uint64_t m_transmissions{0}; //!< Transmissions started.
+    uint64_t m_candidates{0};    //!< Receptions an exhaustive channel would schedule.
+    uint64_t m_deliveries{0};    //!< Receptions scheduled.
+};
+
+NS_OBJECT_ENSURE_REGISTERED(GridSpectrumChannel);
+
+TypeId
+GridSpectrumChannel::GetTypeId()
+{
+    static TypeId tid = TypeId("GridSpectrumChannel")
+                            .SetParent<SpectrumChannel>()
+                            .SetGroupName("Spectrum")
+                            .AddConstructor<GridSpectrumChannel>();
+    return tid;
+}
 
-    cmd.Parse(argc, argv);
+void
+GridSpectrumChannel::SetRange(double cutoff, double slack)
+{
+    m_cutoff = cutoff;
+    m_cellSize = cutoff + slack;
+    m_indexed = false;
+}
 
-    if (nWifi > 9)
-    {
-        std::cout << "nWifi should be 9 or less; otherwise grid layout exceeds the bounding box"
-                  << std::endl;
-        return 1;
-    }
+void
+GridSpectrumChannel::AddRx(Ptr<SpectrumPhy> phy)
+{
+    m_phys.push_back(phy);
+    m_indexed = false;
+}
 
-    if (verbose)
+void
+GridSpectrumChannel::RemoveRx(Ptr<SpectrumPhy> phy)
+{
+    auto it = std::find(m_phys.begin(), m_phys.end(), phy);
+    if (it != m_phys.end())
     {
-        LogComponentEnable("UdpEchoClientApplication", LOG_LEVEL_INFO);
-        LogComponentEnable("UdpEchoServerApplication", LOG_LEVEL_INFO);
+        m_phys.erase(it);
+        m_indexed = false;
     }
+}
 
-    NodeContainer p2pNodes;
-    p2pNodes.Create(2);
+std::size_t
+GridSpectrumChannel::GetNDevices() const
+{
+    return m_phys.size();
+}
 
-    PointToPointHelper pointToPoint;
-    pointToPoint.SetDeviceAttribute("DataRate", StringValue("5Mbps"));
-    pointToPoint.SetChannelAttribute("Delay", StringValue("2ms"));
+Ptr<NetDevice>
+GridSpectrumChannel::GetDevice(std::size_t i) const
+{
+    return m_phys.at(i)->GetDevice();
+}
 
-    NetDeviceContainer p2pDevices;
-    p2pDevices = pointToPoint.Install(p2pNodes);
+int64_t
+GridSpectrumChannel::CellOf(const Vector& position) const
+{
+    auto x = static_cast<int32_t>(std::floor(position.x / m_cellSize));
+    auto y = static_cast<int32_t>(std::floor(position.y / m_cellSize));
+    return (static_cast<int64_t>(x) << 32) | static_cast<uint32_t>(y);
+}
 
-    NodeContainer wifiStaNodes2;
-    wifiStaNodes2.Create(nWifi);
-    NodeContainer wifiApNode2 = p2pNodes.Get(1);
+void
+GridSpectrumChannel::Index()
+{
+    // A mobilidade e instalada depois dos PHYs, por isso o indice so e montado
+    // na primeira transmissao
+    m_cells.clear();
+    m_unplaced.clear();
+    m_byMobility.clear();
+    m_cellOf.assign(m_phys.size(), 0);
+    for (uint32_t rx = 0; rx < m_phys.size(); rx++)
+    {
+        Ptr<MobilityModel> mobility = m_phys[rx]->GetMobility();
+        if (!mobility)
+        {
+            m_unplaced.push_back(rx);
+            continue;
+        }
+        if (m_hooked.insert(PeekPointer(mobility)).second)
+        {
+            mobility->TraceConnectWithoutContext(
+                "CourseChange",
+                MakeCallback(&GridSpectrumChannel::CourseChanged, this));
+        }
+        m_byMobility.emplace(PeekPointer(mobility), rx);
+        m_cellOf[rx] = CellOf(mobility->GetPosition());
+        m_cells[m_cellOf[rx]].push_back(rx);
+    }
+    m_indexed = true;
+}
 
-    YansWifiChannelHelper channel2 = YansWifiChannelHelper::Default();
-    YansWifiPhyHelper phy2;
-    phy2.SetChannel(channel2.Create());
+void
+GridSpectrumChannel::CourseChanged(Ptr<const MobilityModel> mobility)
+{
+    if (!m_indexed)
+    {
+        return;
+    }
+    auto [first, last] = m_byMobility.equal_range(PeekPointer(mobility));
+    for (auto it = first; it != last; ++it)
+    {
+        Reindex(it->second, CellOf(mobility->GetPosition()));
+    }
+}
 
-    WifiMacHelper mac2;
-    Ssid ssid2 = Ssid("ns-3-ssid23");
+void
+GridSpectrumChannel::Reindex(uint32_t rx, int64_t cell)
+{
+    if (m_cellOf[rx] == cell)
+    {
+        return;
+    }
+    std::vector<uint32_t>& old = m_cells[m_cellOf[rx]];
+    auto it = std::find(old.begin(), old.end(), rx);
+    *it = old.back();
+    old.pop_back();
+    m_cellOf[rx] = cell;
+    m_cells[cell].push_back(rx);
+}
 
-    WifiHelper wifi2;
+void
+GridSpectrumChannel::StartTx(Ptr<SpectrumSignalParameters> txParams)
+{
+    if (!m_indexed)
+    {
+        Index();
+    }
+    m_transmissions++;
+    m_candidates += m_phys.size() - 1;
+    Ptr<MobilityModel> senderMobility = txParams->txPhy->GetMobility();
+    if (!senderMobility)
+    {
+        for (const Ptr<SpectrumPhy>& receiver : m_phys)
+        {
+            if (receiver != txParams->txPhy)
+            {
+                Deliver(txParams, receiver);
+            }
+        }
+        return;
+    }
 
-    NetDeviceContainer staDevices2;
-    mac2.SetType("ns3::StaWifiMac", "Ssid", SsidValue(ssid2), "ActiveProbing", BooleanValue(false));
-    staDevices2 = wifi2.Install(phy2, mac2, wifiStaNodes2);
+    Vector position = senderMobility->GetPosition();
+    int64_t center = CellOf(position);
+    auto cx = static_cast<int32_t>(center >> 32);
+    auto cy = static_cast<int32_t>(center & 0xffffffff);
+    for (int32_t dx = -1; dx <= 1; dx++)
+    {
+        for (int32_t dy = -1; dy <= 1; dy++)
+        {
+            auto cell = m_cells.find((static_cast<int64_t>(cx + dx) << 32) |
+                                     static_cast<uint32_t>(cy + dy));
+            if (cell == m_cells.end())
+            {
+                continue;
+            }
+            for (uint32_t rx : cell->second)
+            {
+                Ptr<SpectrumPhy> receiver = m_phys[rx];
+                if (receiver != txParams->txPhy &&
+                    CalculateDistance(position, receiver->GetMobility()->GetPosition()) <=
+                        m_cutoff)
+                {
+                    Deliver(txParams, receiver);
+                }
+            }
+        }
+    }
+    for (uint32_t rx : m_unplaced)
+    {
+        Deliver(txParams, m_phys[rx]);
+    }
+}
 
-    NetDeviceContainer apDevices2;
-    mac2.SetType("ns3::ApWifiMac", "Ssid", SsidValue(ssid2));
-    apDevices2 = wifi2.Install(phy2, mac2, wifiApNode2);
+void
+GridSpectrumChannel::Deliver(Ptr<SpectrumSignalParameters> txParams, Ptr<SpectrumPhy> receiver)
+{
+    // Mesmo calculo de SingleModelSpectrumChannel::StartTx para um receptor
+    Ptr<SpectrumSignalParameters> rxParams = txParams->Copy();
+    Ptr<MobilityModel> senderMobility = txParams->txPhy->GetMobility();
+    Ptr<MobilityModel> receiverMobility = receiver->GetMobility();
+    Time delay = MicroSeconds(0);
+    if (senderMobility && receiverMobility)
+    {
+        double pathLossDb = 0;
+        if (txParams->txAntenna)
+        {
+            Angles txAngles(receiverMobility->GetPosition(), senderMobility->GetPosition());
+            pathLossDb -= txParams->txAntenna->GetGainDb(txAngles);
+        }
+        Ptr<AntennaModel> rxAntenna = DynamicCast<AntennaModel>(receiver->GetAntenna());
+        if (rxAntenna)
+        {
+            Angles rxAngles(senderMobility->GetPosition(), receiverMobility->GetPosition());
+            pathLossDb -= rxAntenna->GetGainDb(rxAngles);
+        }
+        if (m_propagationLoss)
+        {
+            pathLossDb -= m_propagationLoss->CalcRxPower(0, senderMobility, receiverMobility);
+        }
+        if (pathLossDb > m_maxLossDb)
+        {
+            return;
+        }
+        *(rxParams->psd) *= std::pow(10.0, -pathLossDb / 10.0);
+        if (m_spectrumPropagationLoss)
+        {
+            rxParams->psd = m_spectrumPropagationLoss->CalcRxPowerSpectralDensity(rxParams,
+                                                                                  senderMobility,
+                                                                                  receiverMobility);
+        }
+        if (m_propagationDelay)
+        {
+            delay = m_propagationDelay->GetDelay(senderMobility, receiverMobility);
+        }
+    }
+    m_deliveries++;
+    Ptr<NetDevice> device = receiver->GetDevice();
+    uint32_t context = device ? device->GetNode()->GetId() : Simulator::NO_CONTEXT;
+    Simulator::ScheduleWithContext(context, delay, &SpectrumPhy::StartRx, receiver, rxParams);
+}
 
-    MobilityHelper mobility2;
+void
+GridSpectrumChannel::Report(std::ostream& os, const std::string& name) const
+{
+    os << "Channel " << name << ": " << m_transmissions << " transmissions | " << m_deliveries
+       << " of " << m_candidates << " receptions scheduled ("
+       << (m_candidates ? 100.0 * m_deliveries / m_candidates : 0.0) << "%) | cutoff "
+       << m_cutoff << " m" << std::endl;
+}
 
-    mobility2.SetPositionAllocator("ns3::GridPositionAllocator",
-                                  "MinX",
-                                  DoubleValue(0.0),
-                                  "MinY",
-                                  DoubleValue(0.0),
-                                  "DeltaX",
-                                  DoubleValue(5.0),
-                                  "DeltaY",
-                                  DoubleValue(10.0),
-                                  "GridWidth",
-                                  UintegerValue(3),
-                                  "LayoutType",
-                                  StringValue("RowFirst"));
+/**
+ * Create the channel of one BSS in large-cell mode.
+ *
+ * Both kinds share the propagation models of YansWifiChannelHelper::Default(),
+ * so the exhaustive channel is the reference for the grid one.
+ *
+ * @param exhaustive Deliver every transmission to every PHY.
+ * @param cutoff Reception and interference range of the grid channel, in meters.
+ * @param slack Drift allowed between course changes, in meters.
+ * @return The channel.
+ */
+static Ptr<SpectrumChannel>
+CreateCellChannel(bool exhaustive, double cutoff, double slack)
+{
+    Ptr<SpectrumChannel> channel;
+    if (exhaustive)
+    {
+        channel = CreateObject<SingleModelSpectrumChannel>();
+    }
+    else
+    {
+        Ptr<GridSpectrumChannel> grid = CreateObject<GridSpectrumChannel>();
+        grid->SetRange(cutoff, slack);
+        channel = grid;
+    }
+    channel->AddPropagationLossModel(CreateObject<LogDistancePropagationLossModel>());
+    channel->SetPropagationDelayModel(CreateObject<ConstantSpeedPropagationDelayModel>());
+    return channel;
+}
 
-    mobility2.SetMobilityModel("ns3::RandomWalk2dMobilityModel",
-                              "Bounds",
-                              RectangleValue(Rectangle(-50, 50, -50, 50)));
-    mobility2.Install(wifiStaNodes2);
+/**
+ * Settings shared by every BSS built by CellBuilder.
+ */
+struct CellConfig
+{
+    uint32_t nSta{3};                   //!< STAs per BSS.
+    uint32_t gridWidth{3};              //!< STAs per row of the grid.
+    double deltaX{5};                   //!< Distance between columns of the grid, in meters.
+    double deltaY{10};                  //!< Distance between rows of the grid, in meters.
+    Rectangle bounds{-50, 50, -50, 50}; //!< Walk area of the STAs around the cell origin.
+    bool centerAp{false};               //!< Put the AP at the centre of the grid.
+    double cellDistance{0};             //!< Distance between neighbor cell origins, in meters.
+    bool shared{false};                 //!< All BSSs on one channel object.
+    std::vector<uint16_t> channels;     //!< Wi-Fi channel numbers, used in turn; empty = default.
+    bool spectrum{false};               //!< Spectrum channel (largeCell option).
+    bool exhaustive{false};             //!< Spectrum channel without cutoff.
+    double cutoff{100};                 //!< Range of the grid channel, in meters.
+    double courseSlack{10};             //!< Drift tolerated by the grid channel, in meters.
+};
+
+/**
+ * One BSS: an AP and its STAs.
+ */
+struct Cell
+{
+    NodeContainer staNodes;               //!< STAs.
+    Ptr<Node> ap;                         //!< Access point.
+    NetDeviceContainer staDevices;        //!< Wifi devices of the STAs.
+    NetDeviceContainer apDevices;         //!< Wifi device of the AP.
+    Ptr<Channel> channel;                 //!< Channel of the BSS.
+    Ipv4InterfaceContainer staInterfaces; //!< Addresses of the STAs.
+    uint64_t replies{0};                  //!< Echo replies received by its clients.
+    uint64_t replyBytes{0};               //!< Bytes of those replies.
+};
+
+/**
+ * Builds the BSSs of the topology, each around an AP node.
+ *
+ * BSS i gets its own SSID, lays its STAs on a grid at its own origin of a
+ * square arrangement of cells, and uses Wi-Fi channel channels[i % size].
+ * Isolated BSSs each get a channel object of their own and never hear each
+ * other; shared BSSs all use one channel object and interfere whenever their
+ * Wi-Fi channels overlap.
+ */
+class CellBuilder
+{
+  public:
+    /**
+     * Constructor.
+     *
+     * @param config Settings of every BSS.
+     * @param nCells Number of BSSs that will be built.
+     */
+    CellBuilder(const CellConfig& config, uint32_t nCells);
+
+    /**
+     * Build a BSS.
+     *
+     * @param ap The AP node.
+     * @param index Index of the BSS.
+     * @return The BSS.
+     */
+    Cell Build(Ptr<Node> ap, uint32_t index);
+
+    /**
+     * Enable pcap on the AP of a BSS (tracing option).
+     *
+     * @param prefix File name prefix.
+     * @param cell The BSS.
+     */
+    void EnablePcap(const std::string& prefix, const Cell& cell);
+
+  private:
+    /**
+     * PHY helper of the channel kind in use.
+     *
+     * @return The helper.
+     */
+    WifiPhyHelper& Phy();
+
+    /**
+     * Channel for the next BSS: the shared one or a new one.
+     *
+     * @return The channel.
+     */
+    Ptr<Channel> NextChannel();
+
+    CellConfig m_config;                 //!< Settings of every BSS.
+    uint32_t m_columns;                  //!< Cells per row of the arrangement.
+    Ptr<Channel> m_shared;               //!< Channel of every BSS when shared.
+    YansWifiPhyHelper m_yansPhy;         //!< PHY on the default channel.
+    SpectrumWifiPhyHelper m_spectrumPhy; //!< PHY on the large-cell channel.
+};
+
+CellBuilder::CellBuilder(const CellConfig& config, uint32_t nCells)
+    : m_config(config),
+      m_columns(static_cast<uint32_t>(std::ceil(std::sqrt(nCells))))
+{
+}
 
-    mobility2.SetMobilityModel("ns3::ConstantPositionMobilityModel");
-    mobility2.Install(wifiApNode2);
+WifiPhyHelper&
+CellBuilder::Phy()
+{
+    if (m_config.spectrum)
+    {
+        return m_spectrumPhy;
+    }
+    return m_yansPhy;
+}
 
-    NodeContainer wifiStaNodes;
-    wifiStaNodes.Create(nWifi);
-    NodeContainer wifiApNode = p2pNodes.Get(0);
+Ptr<Channel>
+CellBuilder::NextChannel()
+{
+    if (m_shared)
+    {
+        return m_shared;
+    }
+    Ptr<Channel> channel;
+    if (m_config.spectrum)
+    {
+        channel = CreateCellChannel(m_config.exhaustive, m_config.cutoff, m_config.courseSlack);
+    }
+    else
+    {
+        YansWifiChannelHelper helper = YansWifiChannelHelper::Default();
+        channel = helper.Create();
+    }
+    if (m_config.shared)
+    {
+        m_shared = channel;
+    }
+    return channel;
+}
 
-    YansWifiChannelHelper channel = YansWifiChannelHelper::Default();
-    YansWifiPhyHelper phy;
-    phy.SetChannel(channel.Create());
+Cell
+CellBuilder::Build(Ptr<Node> ap, uint32_t index)
+{
+    Cell cell;
+    cell.ap = ap;
+    cell.staNodes.Create(m_config.nSta);
+    cell.channel = NextChannel();
+    if (m_config.spectrum)
+    {
+        m_spectrumPhy.SetChannel(DynamicCast<SpectrumChannel>(cell.channel));
+    }
+    else
+    {
+        m_yansPhy.SetChannel(DynamicCast<YansWifiChannel>(cell.channel));
+    }
+    if (!m_config.channels.empty())
+    {
+        uint16_t number = m_config.channels[index % m_config.channels.size()];
+        Phy().Set("ChannelSettings",
+                  StringValue("{" + std::to_string(number) + ", 20, BAND_5GHZ, 0}"));
+    }
 
     WifiMacHelper mac;
-    Ssid ssid = Ssid("ns-3-ssid");
+    // Os dois primeiros BSSs mantem os SSIDs do script de duas celulas
+    Ssid ssid = Ssid(index == 0   ? std::string("ns-3-ssid")
+                     : index == 1 ? std::string("ns-3-ssid23")
+                                  : "ns-3-ssid" + std::to_string(index + 1));
 
     WifiHelper wifi;
 
-    NetDeviceContainer staDevices;
     mac.SetType("ns3::StaWifiMac", "Ssid", SsidValue(ssid), "ActiveProbing", BooleanValue(false));
-    staDevices = wifi.Install(phy, mac, wifiStaNodes);
+    cell.staDevices = wifi.Install(Phy(), mac, cell.staNodes);
 
-    NetDeviceContainer apDevices;
     mac.SetType("ns3::ApWifiMac", "Ssid", SsidValue(ssid));
-    apDevices = wifi.Install(phy, mac, wifiApNode);
+    cell.apDevices = wifi.Install(Phy(), mac, ap);
+
+    double originX = (index % m_columns) * m_config.cellDistance;
+    double originY = (index / m_columns) * m_config.cellDistance;
+    const Rectangle& bounds = m_config.bounds;
 
     MobilityHelper mobility;
 
     mobility.SetPositionAllocator("ns3::GridPositionAllocator",
                                   "MinX",
-                                  DoubleValue(0.0),
+                                  DoubleValue(originX),
                                   "MinY",
-                                  DoubleValue(0.0),
+                                  DoubleValue(originY),
                                   "DeltaX",
-                                  DoubleValue(5.0),
+                                  DoubleValue(m_config.deltaX),
                                   "DeltaY",
-                                  DoubleValue(10.0),
+                                  DoubleValue(m_config.deltaY),
                                   "GridWidth",
-                                  UintegerValue(3),
+                                  UintegerValue(m_config.gridWidth),
                                   "LayoutType",
                                   StringValue("RowFirst"));
 
     mobility.SetMobilityModel("ns3::RandomWalk2dMobilityModel",
                               "Bounds",
-                              RectangleValue(Rectangle(-50, 50, -50, 50)));
-    mobility.Install(wifiStaNodes);
+                              RectangleValue(Rectangle(bounds.xMin + originX,
+                                                       bounds.xMax + originX,
+                                                       bounds.yMin + originY,
+                                                       bounds.yMax + originY)));
+    mobility.Install(cell.staNodes);
 
     mobility.SetMobilityModel("ns3::ConstantPositionMobilityModel");
-    mobility.Install(wifiApNode);
+    mobility.Install(ap);
 
+    if (m_config.centerAp)
+    {
+        uint32_t rows = (m_config.nSta + m_config.gridWidth - 1) / m_config.gridWidth;
+        ap->GetObject<MobilityModel>()->SetPosition(
+            Vector(originX + (m_config.gridWidth - 1) * m_config.deltaX / 2,
+                   originY + (rows - 1) * m_config.deltaY / 2,
+                   0));
+    }
+    return cell;
+}
+
+void
+CellBuilder::EnablePcap(const std::string& prefix, const Cell& cell)
+{
+    Phy().SetPcapDataLinkType(WifiPhyHelper::DLT_IEEE802_11_RADIO);
+    Phy().EnablePcap(prefix, cell.apDevices.Get(0));
+}
+
+/**
+ * Set the subnet of a BSS.
+ *
+ * The first two BSSs keep 10.1.3.0/24 and 10.1.2.0/24 of the two-cell
+ * script, the others get 10.3.i.0/24, and a BSS too large for a /24 gets
+ * 10.(16+i).0.0/16.
+ *
+ * @param address The address helper.
+ * @param index Index of the BSS.
+ * @param hosts STAs plus the AP.
+ */
+static void
+SetCellBase(Ipv4AddressHelper& address, uint32_t index, uint32_t hosts)
+{
+    if (hosts > 254)
+    {
+        address.SetBase(Ipv4Address(("10." + std::to_string(16 + index) + ".0.0").c_str()),
+                        "255.255.0.0");
+    }
+    else if (index < 2)
+    {
+        address.SetBase(index == 0 ? "10.1.3.0" : "10.1.2.0", "255.255.255.0");
+    }
+    else
+    {
+        address.SetBase(Ipv4Address(("10.3." + std::to_string(index) + ".0").c_str()),
+                        "255.255.255.0");
+    }
+}
+
+/**
+ * Rx trace of an echo client.
+ *
+ * @param cell BSS of the client.
+ * @param packet The echo reply.
+ */
+static void
+CellEchoRx(Cell* cell, Ptr<const Packet> packet)
+{
+    cell->replies++;
+    cell->replyBytes += packet->GetSize();
+}
+
+int
+main(int argc, char* argv[])
+{
+    bool verbose = true;
+    uint32_t nPackets = 3;
+    uint32_t nWifi = 3;
+    bool tracing = false;
+    bool profile = false;
+    std::string scheduler = "map";
+    bool pcapAsync = false;
+    uint32_t pcapSnaplen = 128;
+    uint64_t pcapRotateBytes = 0;
+    Time pcapRotateTime = Seconds(0);
+    uint32_t pcapMaxFiles = 0;
+    bool largeCell = false;
+    double spacing = 5.0;
+    double cutoff = 100.0;
+    double courseSlack = 10.0;
+    bool exhaustive = false;
+    uint32_t nCells = 2;
+    bool sharedChannel = false;
+    std::string channels;
+    double cellDistance = 0.0;
+
+    CommandLine cmd(__FILE__);
+    cmd.AddValue("nPackets", "Number of \"extra\" CSMA nodes/devices", nPackets);
+    cmd.AddValue("nWifi", "Number of wifi STA devices per BSS", nWifi);
+    cmd.AddValue("nCells",
+                 "Number of BSSs; the AP of BSS 0 has a point-to-point link to every other AP",
+                 nCells);
+    cmd.AddValue("sharedChannel",
+                 "Put every BSS on one channel, so BSSs on overlapping Wi-Fi channels interfere",
+                 sharedChannel);
+    cmd.AddValue("channels",
+                 "Comma-separated 5 GHz channel numbers given to the BSSs in turn, e.g. "
+                 "36,40,44,48 (empty = default channel)",
+                 channels);
+    cmd.AddValue("cellDistance", "Distance between neighbor BSS origins, m", cellDistance);
+    cmd.AddValue("verbose", "Tell echo applications to log if true", verbose);
+    cmd.AddValue("tracing", "Enable pcap tracing", tracing);
+    cmd.AddValue("profile",
+                 "Time each phase of the run and report events/s and simulated seconds per "
+                 "wall second",
+                 profile);
+    cmd.AddValue("scheduler",
+                 "Event scheduler: map, list, heap, calendar or priority",
+                 scheduler);
+    cmd.AddValue("pcapAsync",
+                 "Capture pcap from a background writer thread, keeping pcapSnaplen bytes "
+                 "of each packet",
+                 pcapAsync);
+    cmd.AddValue("pcapSnaplen", "Bytes kept of each packet (pcapAsync)", pcapSnaplen);
+    cmd.AddValue("pcapRotateBytes",
+                 "Pcap file size to rotate at, 0 = no limit (pcapAsync)",
+                 pcapRotateBytes);
+    cmd.AddValue("pcapRotateTime",
+                 "Simulated time per pcap file, 0 = no limit (pcapAsync)",
+                 pcapRotateTime);
+    cmd.AddValue("pcapMaxFiles",
+                 "Pcap files kept per device, 0 = all (pcapAsync)",
+                 pcapMaxFiles);
+    cmd.AddValue("largeCell",
+                 "Lay nWifi STAs per BSS on a square grid on a spectrum channel and run one "
+                 "echo client per STA; a BSS of more than 253 STAs gets a /16",
+                 largeCell);
+    cmd.AddValue("spacing", "Distance between neighbor STAs of the grid, m (largeCell)", spacing);
+    cmd.AddValue("cutoff",
+                 "Reception and interference range of the channel, m (largeCell)",
+                 cutoff);
+    cmd.AddValue("courseSlack",
+                 "Drift of a STA between course changes the channel index tolerates, m "
+                 "(largeCell)",
+                 courseSlack);
+    cmd.AddValue("exhaustive",
+                 "Deliver every frame to every PHY instead of using the cutoff (largeCell)",
+                 exhaustive);
+
+    cmd.Parse(argc, argv);
+    profiler.Start(profile);
+    SelectScheduler(scheduler);
+
+    if (largeCell && (spacing <= 0 || cutoff <= 0 || courseSlack < 0))
+    {
+        NS_FATAL_ERROR("spacing e cutoff precisam ser positivos e courseSlack nao negativo.");
+    }
+    if (!largeCell && nWifi > 9)
+    {
+        std::cout << "nWifi should be 9 or less; otherwise grid layout exceeds the bounding box"
+                  << std::endl;
+        return 1;
+    }
+    if (nWifi == 0 || nWifi > 65000)
+    {
+        NS_FATAL_ERROR("nWifi precisa estar entre 1 e 65000.");
+    }
+    if (nCells < 2 || nCells > 200)
+    {
+        NS_FATAL_ERROR("nCells precisa estar entre 2 e 200.");
+    }
+
+    CellConfig config;
+    config.nSta = nWifi;
+    config.cellDistance = cellDistance;
+    config.shared = sharedChannel;
+    config.spectrum = largeCell;
+    config.exhaustive = exhaustive;
+    config.cutoff = cutoff;
+    config.courseSlack = courseSlack;
+    std::istringstream channelList(channels);
+    for (std::string number; std::getline(channelList, number, ',');)
+    {
+        if (number.empty() || number.find_first_not_of("0123456789") != std::string::npos ||
+            number.size() > 3)
+        {
+            NS_FATAL_ERROR("channels precisa ser uma lista de numeros de canal separados por "
+                           "virgula.");
+        }
+        config.channels.push_back(static_cast<uint16_t>(std::stoul(number)));
+    }
+    if (largeCell)
+    {
+        // Grade quadrada que cabe nWifi STAs; o AP fica no centro
+        config.gridWidth = static_cast<uint32_t>(std::ceil(std::sqrt(nWifi)));
+        config.deltaX = spacing;
+        config.deltaY = spacing;
+        double side = (config.gridWidth - 1) * spacing;
+        config.bounds = Rectangle(-spacing, side + spacing, -spacing, side + spacing);
+        config.centerAp = true;
+    }
+
+    if (verbose)
+    {
+        LogComponentEnable("UdpEchoClientApplication", LOG_LEVEL_INFO);
+        LogComponentEnable("UdpEchoServerApplication", LOG_LEVEL_INFO);
+    }
+
+    // Um AP por BSS; o AP 0 liga a todos os outros por enlaces ponto a ponto
+    NodeContainer apNodes;
+    apNodes.Create(nCells);
+
+    PointToPointHelper pointToPoint;
+    pointToPoint.SetDeviceAttribute("DataRate", StringValue("5Mbps"));
+    pointToPoint.SetChannelAttribute("Delay", StringValue("2ms"));
+
+    std::vector<NetDeviceContainer> p2pLinks;
+    for (uint32_t i = 1; i < nCells; i++)
+    {
+        p2pLinks.push_back(pointToPoint.Install(apNodes.Get(0), apNodes.Get(i)));
+    }
+
+    // O servidor fica na ultima STA do BSS 1; os outros BSSs tem clientes.
+    // O BSS do servidor e montado primeiro, como no script de duas celulas,
+    // para que nCells=2 crie os objetos na mesma ordem e repita seus resultados
+    const uint32_t serverCell = 1;
+    std::vector<uint32_t> buildOrder{serverCell};
+    for (uint32_t i = 0; i < nCells; i++)
+    {
+        if (i != serverCell)
+        {
+            buildOrder.push_back(i);
+        }
+    }
+
+    CellBuilder builder(config, nCells);
+    std::vector<Cell> cells(nCells);
+    for (uint32_t i : buildOrder)
+    {
+        cells[i] = builder.Build(apNodes.Get(i), i);
+    }
+
+    profiler.Mark("topology");
     InternetStackHelper stack;
-    stack.Install(wifiApNode2);
-    stack.Install(wifiStaNodes2);
-    stack.Install(wifiApNode);
-    stack.Install(wifiStaNodes);
+    for (uint32_t i : buildOrder)
+    {
+        stack.Install(apNodes.Get(i));
+        stack.Install(cells[i].staNodes);
+    }
 
     Ipv4AddressHelper address;
 
-    address.SetBase("10.1.1.0", "255.255.255.0");
-    Ipv4InterfaceContainer p2pInterfaces;
-    p2pInterfaces = address.Assign(p2pDevices);
-
-    Ipv4InterfaceContainer wifiInterfaces;
-    address.SetBase("10.1.2.0", "255.255.255.0");
-    wifiInterfaces = address.Assign(staDevices2);
-    address.Assign(apDevices2);
+    for (uint32_t i = 1; i < nCells; i++)
+    {
+        address.SetBase(i == 1 ? Ipv4Address("10.1.1.0")
+                               : Ipv4Address(("10.2." + std::to_string(i) + ".0").c_str()),
+                        "255.255.255.0");
+        address.Assign(p2pLinks[i - 1]);
+    }
 
-    
-    address.SetBase("10.1.3.0", "255.255.255.0");
-    address.Assign(staDevices);
-    address.Assign(apDevices);
+    for (uint32_t i : buildOrder)
+    {
+        SetCellBase(address, i, nWifi + 1);
+        cells[i].staInterfaces = address.Assign(cells[i].staDevices);
+        address.Assign(cells[i].apDevices);
+    }
 
+    profiler.Mark("stack");
     UdpEchoServerHelper echoServer(9);
 
-    ApplicationContainer serverApps = echoServer.Install(wifiStaNodes2.Get(nWifi-1));
+    ApplicationContainer serverApps = echoServer.Install(cells[serverCell].staNodes.Get(nWifi - 1));
     serverApps.Start(Seconds(1));
     serverApps.Stop(Seconds(10));
 
-    UdpEchoClientHelper echoClient(wifiInterfaces.GetAddress(nWifi-1), 9);
+    UdpEchoClientHelper echoClient(cells[serverCell].staInterfaces.GetAddress(nWifi - 1), 9);
     echoClient.SetAttribute("MaxPackets", UintegerValue(nPackets));
     echoClient.SetAttribute("Interval", TimeValue(Seconds(1)));
     echoClient.SetAttribute("PacketSize", UintegerValue(1024));
 
-    ApplicationContainer clientApps = echoClient.Install(wifiStaNodes.Get(nWifi - 1));
-    clientApps.Start(Seconds(2));
+    ApplicationContainer clientApps;
+    Ptr<UniformRandomVariable> jitter;
+    if (largeCell)
+    {
+        jitter = CreateObject<UniformRandomVariable>();
+    }
+    for (uint32_t i = 0; i < nCells; i++)
+    {
+        if (i == serverCell)
+        {
+            continue;
+        }
+        ApplicationContainer apps;
+        if (largeCell)
+        {
+            // Um cliente por STA, com inicio espalhado em um intervalo para nao
+            // transmitirem todos no mesmo instante
+            apps = echoClient.Install(cells[i].staNodes);
+            for (uint32_t j = 0; j < apps.GetN(); j++)
+            {
+                apps.Get(j)->SetStartTime(Seconds(2 + jitter->GetValue(0, 1)));
+            }
+        }
+        else
+        {
+            apps = echoClient.Install(cells[i].staNodes.Get(nWifi - 1));
+            apps.Start(Seconds(2));
+        }
+        for (uint32_t j = 0; j < apps.GetN(); j++)
+        {
+            apps.Get(j)->TraceConnectWithoutContext("Rx",
+                                                    MakeBoundCallback(&CellEchoRx, &cells[i]));
+        }
+        clientApps.Add(apps);
+    }
     clientApps.Stop(Seconds(10));
 
+    profiler.Mark("apps");
     Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+    profiler.Mark("routing");
 
     Simulator::Stop(Seconds(10));
 
-    if (tracing)
+    if (tracing && pcapAsync)
+    {
+        pcapWriter.Start(pcapSnaplen, pcapRotateBytes, pcapRotateTime, pcapMaxFiles);
+        for (const NetDeviceContainer& link : p2pLinks)
+        {
+            pcapWriter.Add("third", link.Get(0));
+            pcapWriter.Add("third", link.Get(1));
+        }
+        for (const Cell& cell : cells)
+        {
+            pcapWriter.Add("third", cell.apDevices.Get(0));
+        }
+    }
+    else if (tracing)
     {
-        phy.SetPcapDataLinkType(WifiPhyHelper::DLT_IEEE802_11_RADIO);
         pointToPoint.EnablePcapAll("third");
-        phy.EnablePcap("third", apDevices.Get(0));
-        phy2.EnablePcap("third", apDevices.Get(0));
+        for (const Cell& cell : cells)
+        {
+            builder.EnablePcap("third", cell);
+        }
     }
 
+    profiler.Mark("pcap");
     Simulator::Run();
+    profiler.Mark("run");
+    uint64_t events = Simulator::GetEventCount();
+    double simulatedSeconds = Simulator::Now().GetSeconds();
+    if (pcapWriter.IsEnabled())
+    {
+        pcapWriter.Stop();
+        pcapWriter.Report(std::cout);
+    }
+
+    // Clientes ativos de 2 s a 10 s
+    const double activeSeconds = 8.0;
+    uint64_t requestsPerCell = largeCell ? uint64_t(nWifi) * nPackets : nPackets;
+    uint64_t replies = 0;
+    uint64_t replyBytes = 0;
+    for (uint32_t i = 0; i < nCells; i++)
+    {
+        if (i == serverCell)
+        {
+            continue;
+        }
+        replies += cells[i].replies;
+        replyBytes += cells[i].replyBytes;
+        std::cout << "BSS " << i << ": " << cells[i].replies << " replies of " << requestsPerCell
+                  << " requests | goodput " << cells[i].replyBytes * 8 / activeSeconds << " bps"
+                  << std::endl;
+    }
+    std::cout << "Cell: " << nWifi << " STAs x " << nCells << " BSSs | " << replies
+              << " replies of " << requestsPerCell * (nCells - 1) << " requests | goodput "
+              << replyBytes * 8 / activeSeconds << " bps | "
+              << (sharedChannel ? "shared " : "isolated ")
+              << (!largeCell ? "yans" : exhaustive ? "exhaustive" : "grid") << " channel"
+              << std::endl;
+    if (largeCell)
+    {
+        for (uint32_t i = 0; i < nCells; i++)
+        {
+            if (Ptr<GridSpectrumChannel> grid = DynamicCast<GridSpectrumChannel>(cells[i].channel))
+            {
+                grid->Report(std::cout, "BSS " + std::to_string(i));
+            }
+            if (sharedChannel)
+            {
+                break;
+            }
+        }
+    }
     Simulator::Destroy();
+    profiler.Mark("teardown");
+    profiler.Report(std::cout, simulatedSeconds, events);
     return 0;
 }
@@ -0,0 +1,1880 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/**
+ * Code shared by lab2-part1 and lab2-part2: the TCP tracers and their sinks,
+ * the result records, the replication statistics, the convergence monitor
+ * and the per-flow goodput and edge monitors. The profiler and the scheduler
+ * selection, used by every lab, are in lab-common.h.
+ *
+ * Each program is a single translation unit, so the globals below are static
+ * and belong to the program that includes this header.
+ */
+
+#ifndef LAB2_COMMON_H
+#define LAB2_COMMON_H
+
+#include "ns3/applications-module.h"
+#include "ns3/core-module.h"
+#include "ns3/flow-monitor-helper.h"
+#include "ns3/internet-module.h"
+#include "ns3/ipv4-flow-classifier.h"
+#include "ns3/network-module.h"
+#include "ns3/tcp-header.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace ns3;
+
+/**
+ * Metrics recorded by the TCP tracers.
+ */
+enum TraceMetric : uint16_t
+{
+    METRIC_CWND = 0, //!< Congestion window.
+    METRIC_SSTH,     //!< Slow start threshold.
+    METRIC_RTT,      //!< RTT, in seconds.
+    METRIC_RTO,      //!< RTO, in seconds.
+    METRIC_NEXT_TX,  //!< Next TX sequence number.
+    METRIC_INFLIGHT, //!< Bytes in flight.
+    METRIC_NEXT_RX,  //!< Next RX sequence number (sink side).
+    METRIC_COUNT,    //!< Number of metrics.
+};
+
+/**
+ * Metric names, as written in the multiplexed text trace and in the .data file names.
+ */
+static const char* const METRIC_NAMES[METRIC_COUNT] =
+    {"cwnd", "ssth", "rtt", "rto", "next-tx", "inflight", "next-rx"};
+
+/**
+ * Online reduction applied to the trace samples before they reach the sink.
+ */
+enum TraceMode
+{
+    TRACE_FULL,   //!< Every sample.
+    TRACE_CHANGE, //!< Only samples that moved more than traceThreshold from the last one written.
+    TRACE_BUCKET, //!< Min, max and last value per time bucket.
+};
+
+/**
+ * Aggregate kind, carried in the high byte of TraceRecord::metric.
+ */
+enum TraceAggregate : uint16_t
+{
+    AGG_LAST = 0, //!< Plain sample, or last value of a bucket.
+    AGG_MIN = 1,  //!< Minimum of a bucket.
+    AGG_MAX = 2,  //!< Maximum of a bucket.
+};
+
+static TraceMode reductionMode = TRACE_FULL; //!< Reduction mode.
+static double traceThreshold = 0.05;         //!< Relative change threshold (change mode).
+static int64_t traceBucketNs = 10000000;     //!< Bucket width, in nanoseconds (bucket mode).
+
+/**
+ * Per-flow tracer state, one array per field, indexed by the flow slot that is
+ * bound into each trace callback. The slot is also the flow ID in the trace.
+ */
+struct FlowTraceTable
+{
+    std::vector<uint32_t> senderNode;    //!< Node ID of the BulkSend socket.
+    std::vector<uint32_t> sinkNode;      //!< Node ID of the sink-side socket.
+    std::vector<Ptr<PacketSink>> sink;   //!< Sink application of the flow.
+    std::vector<uint8_t> sinkHooked;     //!< Whether the sink-side socket is hooked.
+    std::vector<uint32_t> cWndValue;     //!< Last congestion window value.
+    std::vector<uint32_t> ssThreshValue; //!< Last slow start threshold value.
+    std::array<std::vector<uint8_t>, METRIC_COUNT> first; //!< Initial sample still pending.
+    std::array<std::vector<uint8_t>, METRIC_COUNT> written;    //!< A value was already written.
+    std::array<std::vector<double>, METRIC_COUNT> lastValue;   //!< Last value written or bucketed.
+    std::array<std::vector<double>, METRIC_COUNT> minValue;    //!< Minimum of the open bucket.
+    std::array<std::vector<double>, METRIC_COUNT> maxValue;    //!< Maximum of the open bucket.
+    std::array<std::vector<int64_t>, METRIC_COUNT> bucket;     //!< Open bucket index, -1 if none.
+    std::array<std::vector<double>, METRIC_COUNT> heldValue;   //!< Newest value held back.
+    std::array<std::vector<int64_t>, METRIC_COUNT> heldTimeNs; //!< Time of heldValue, -1 if none.
+
+    /**
+     * Allocate a slot for a flow.
+     *
+     * @param sender Node ID of the sender.
+     * @param sinkApp Sink application of the flow.
+     * @return the slot.
+     */
+    uint32_t Add(uint32_t sender, Ptr<PacketSink> sinkApp)
+    {
+        senderNode.push_back(sender);
+        sinkNode.push_back(sinkApp->GetNode()->GetId());
+        sink.push_back(sinkApp);
+        sinkHooked.push_back(false);
+        cWndValue.push_back(0);
+        ssThreshValue.push_back(0);
+        for (uint32_t m = 0; m < METRIC_COUNT; m++)
+        {
+            first[m].push_back(true);
+            written[m].push_back(false);
+            lastValue[m].push_back(0);
+            minValue[m].push_back(0);
+            maxValue[m].push_back(0);
+            bucket[m].push_back(-1);
+            heldValue[m].push_back(0);
+            heldTimeNs[m].push_back(-1);
+        }
+        return senderNode.size() - 1;
+    }
+
+    /**
+     * Release all slots.
+     */
+    void Clear()
+    {
+        senderNode.clear();
+        sinkNode.clear();
+        sink.clear();
+        sinkHooked.clear();
+        cWndValue.clear();
+        ssThreshValue.clear();
+        for (uint32_t m = 0; m < METRIC_COUNT; m++)
+        {
+            first[m].clear();
+            written[m].clear();
+            lastValue[m].clear();
+            minValue[m].clear();
+            maxValue[m].clear();
+            bucket[m].clear();
+            heldValue[m].clear();
+            heldTimeNs[m].clear();
+        }
+    }
+};
+
+static FlowTraceTable traceTable;         //!< Tracer state of every traced flow.
+static Ptr<OutputStreamWrapper> tcpTrace; //!< Multiplexed text trace (traceFormat=text).
+
+/**
+ * Fixed-size binary trace record. The layout is mirrored by converte_trace.py.
+ */
+struct TraceRecord
+{
+    int64_t timeNs;  //!< Simulation time, in nanoseconds.
+    uint32_t node;   //!< Node ID of the traced socket.
+    uint16_t flow;   //!< Flow ID.
+    uint16_t metric; //!< TraceMetric, with the TraceAggregate in the high byte.
+    double value;    //!< Sampled value.
+};
+
+static_assert(sizeof(TraceRecord) == 24, "converte_trace.py expects 24-byte records");
+
+/**
+ * Buffered writer for binary trace records.
+ *
+ * Records are kept in a preallocated buffer and written out in large blocks,
+ * optionally compressed on the fly by a gzip pipe.
+ */
+class BinaryTraceWriter
+{
+  public:
+    ~BinaryTraceWriter()
+    {
+        Close();
+    }
+
+    /**
+     * Open the output file and write the file header.
+     *
+     * @param fileName Output file name (".gz" is appended when compressing).
+     * @param compress Whether to pipe the output through gzip.
+     * @param bufferRecords Number of records buffered between writes.
+     */
+    void Open(const std::string& fileName, bool compress, std::size_t bufferRecords)
+    {
+        Close();
+        m_pipe = compress;
+        if (compress)
+        {
+            m_file = popen(("gzip -1 -c > '" + fileName + ".gz'").c_str(), "w");
+        }
+        else
+        {
+            m_file = std::fopen(fileName.c_str(), "wb");
+        }
+        if (!m_file)
+        {
+            NS_FATAL_ERROR("Nao foi possivel abrir o trace binario " << fileName);
+        }
+        static const char magic[8] = {'T', 'C', 'P', 'T', 'R', 'C', '0', '1'};
+        std::fwrite(magic, 1, sizeof(magic), m_file);
+        m_buffer.clear();
+        m_buffer.reserve(bufferRecords);
+    }
+
+    /**
+     * @return true if the writer has an open output file.
+     */
+    bool IsOpen() const
+    {
+        return m_file != nullptr;
+    }
+
+    /**
+     * Append one record, writing the buffer out when it is full.
+     *
+     * @param timeNs Sample time, in nanoseconds.
+     * @param node Node ID.
+     * @param flow Flow ID.
+     * @param metric Traced metric and aggregate kind.
+     * @param value Sampled value.
+     */
+    void Append(int64_t timeNs, uint32_t node, uint16_t flow, uint16_t metric, double value)
+    {
+        m_buffer.push_back({timeNs, node, flow, metric, value});
+        if (m_buffer.size() == m_buffer.capacity())
+        {
+            Flush();
+        }
+    }
+
+    /**
+     * Write the buffered records to the output file.
+     */
+    void Flush()
+    {
+        if (m_file && !m_buffer.empty())
+        {
+            std::fwrite(m_buffer.data(), sizeof(TraceRecord), m_buffer.size(), m_file);
+            m_buffer.clear();
+        }
+    }
+
+    /**
+     * Flush the buffer and close the output file.
+     */
+    void Close()
+    {
+        if (!m_file)
+        {
+            return;
+        }
+        Flush();
+        if (m_pipe)
+        {
+            pclose(m_file);
+        }
+        else
+        {
+            std::fclose(m_file);
+        }
+        m_file = nullptr;
+    }
+
+  private:
+    std::FILE* m_file{nullptr};        //!< Output file or gzip pipe.
+    bool m_pipe{false};                //!< Whether m_file is a pipe.
+    std::vector<TraceRecord> m_buffer; //!< Records not yet written.
+};
+
+static BinaryTraceWriter binaryTrace; //!< Binary trace sink (traceFormat=binary).
+
+/**
+ * Convert a traced value to the binary record representation.
+ *
+ * @param value The traced value.
+ * @return the value as a double.
+ */
+static double
+SampleValue(double value)
+{
+    return value;
+}
+
+/**
+ * Convert a traced value to the binary record representation.
+ *
+ * @param value The traced value.
+ * @return the value as a double.
+ */
+static double
+SampleValue(uint32_t value)
+{
+    return value;
+}
+
+/**
+ * Convert a traced sequence number to the binary record representation.
+ *
+ * @param value The traced sequence number.
+ * @return the raw sequence number as a double.
+ */
+static double
+SampleValue(SequenceNumber32 value)
+{
+    return value.GetValue();
+}
+
+/**
+ * Write one value to the trace sink, as a line of the multiplexed text trace or
+ * as a binary record.
+ *
+ * @param slot Flow slot.
+ * @param metric Traced metric.
+ * @param aggregate Aggregate kind of the value.
+ * @param timeNs Time of the value, in nanoseconds; zero marks the initial sample.
+ * @param value The value.
+ */
+static void
+EmitSample(uint32_t slot, TraceMetric metric, TraceAggregate aggregate, int64_t timeNs, double value)
+{
+    if (binaryTrace.IsOpen())
+    {
+        binaryTrace.Append(timeNs,
+                           metric == METRIC_NEXT_RX ? traceTable.sinkNode[slot]
+                                                    : traceTable.senderNode[slot],
+                           slot,
+                           metric | (aggregate << 8),
+                           value);
+        return;
+    }
+    std::ostream& os = *tcpTrace->GetStream();
+    if (timeNs == 0)
+    {
+        os << "0.0 ";
+    }
+    else
+    {
+        os << timeNs / 1e9 << " ";
+    }
+    os << slot << " " << METRIC_NAMES[metric];
+    if (aggregate == AGG_MIN)
+    {
+        os << "-min";
+    }
+    else if (aggregate == AGG_MAX)
+    {
+        os << "-max";
+    }
+    if (metric == METRIC_RTT || metric == METRIC_RTO)
+    {
+        os << " " << value << '\n';
+    }
+    else
+    {
+        os << " " << static_cast<uint64_t>(value) << '\n';
+    }
+}
+
+/**
+ * Write out the open bucket of a metric as its min, max and last values.
+ *
+ * @param slot Flow slot.
+ * @param metric Traced metric.
+ * @param limitNs Upper bound for the bucket end time, in nanoseconds.
+ */
+static void
+CloseBucket(uint32_t slot, TraceMetric metric, int64_t limitNs)
+{
+    int64_t& index = traceTable.bucket[metric][slot];
+    if (index < 0)
+    {
+        return;
+    }
+    int64_t endNs = std::min((index + 1) * traceBucketNs, limitNs);
+    EmitSample(slot, metric, AGG_MIN, endNs, traceTable.minValue[metric][slot]);
+    EmitSample(slot, metric, AGG_MAX, endNs, traceTable.maxValue[metric][slot]);
+    EmitSample(slot, metric, AGG_LAST, endNs, traceTable.lastValue[metric][slot]);
+    index = -1;
+}
+
+/**
+ * Write one trace sample through the configured reduction mode.
+ *
+ * @param slot Flow slot.
+ * @param metric Traced metric.
+ * @param initial Whether this is the initial sample, reported at time zero.
+ * @param sample Sampled value.
+ */
+template <typename T>
+static void
+WriteSample(uint32_t slot, TraceMetric metric, bool initial, T sample)
+{
+    double value = SampleValue(sample);
+    double& last = traceTable.lastValue[metric][slot];
+    if (initial)
+    {
+        EmitSample(slot, metric, AGG_LAST, 0, value);
+        traceTable.written[metric][slot] = true;
+        last = value;
+        return;
+    }
+
+    int64_t nowNs = Simulator::Now().GetNanoSeconds();
+    switch (reductionMode)
+    {
+    case TRACE_FULL:
+        EmitSample(slot, metric, AGG_LAST, nowNs, value);
+        break;
+    case TRACE_CHANGE:
+        if (!traceTable.written[metric][slot] ||
+            std::abs(value - last) > traceThreshold * std::abs(last))
+        {
+            EmitSample(slot, metric, AGG_LAST, nowNs, value);
+            traceTable.written[metric][slot] = true;
+            traceTable.heldTimeNs[metric][slot] = -1;
+            last = value;
+        }
+        else
+        {
+            traceTable.heldValue[metric][slot] = value;
+            traceTable.heldTimeNs[metric][slot] = nowNs;
+        }
+        break;
+    case TRACE_BUCKET: {
+        int64_t index = nowNs / traceBucketNs;
+        if (index != traceTable.bucket[metric][slot])
+        {
+            CloseBucket(slot, metric, nowNs);
+            traceTable.bucket[metric][slot] = index;
+            traceTable.minValue[metric][slot] = value;
+            traceTable.maxValue[metric][slot] = value;
+        }
+        else
+        {
+            traceTable.minValue[metric][slot] = std::min(traceTable.minValue[metric][slot], value);
+            traceTable.maxValue[metric][slot] = std::max(traceTable.maxValue[metric][slot], value);
+        }
+        last = value;
+        break;
+    }
+    }
+}
+
+/**
+ * Write out what the reduction is still holding back: the newest suppressed
+ * value of each metric in change mode, the open buckets in bucket mode.
+ */
+static void
+FlushTraceReduction()
+{
+    int64_t nowNs = Simulator::Now().GetNanoSeconds();
+    for (uint32_t slot = 0; slot < traceTable.senderNode.size(); slot++)
+    {
+        for (uint32_t m = 0; m < METRIC_COUNT; m++)
+        {
+            TraceMetric metric = static_cast<TraceMetric>(m);
+            if (traceTable.heldTimeNs[m][slot] >= 0)
+            {
+                EmitSample(slot,
+                           metric,
+                           AGG_LAST,
+                           traceTable.heldTimeNs[m][slot],
+                           traceTable.heldValue[m][slot]);
+                traceTable.heldTimeNs[m][slot] = -1;
+            }
+            CloseBucket(slot, metric, nowNs);
+        }
+    }
+}
+
+/**
+ * Congestion window tracer.
+ *
+ * @param slot Flow slot.
+ * @param oldval Old value.
+ * @param newval New value.
+ */
+static void
+CwndTracer(uint32_t slot, uint32_t oldval, uint32_t newval)
+{
+    if (traceTable.first[METRIC_CWND][slot])
+    {
+        WriteSample(slot, METRIC_CWND, true, oldval);
+        traceTable.first[METRIC_CWND][slot] = false;
+    }
+    WriteSample(slot, METRIC_CWND, false, newval);
+    traceTable.cWndValue[slot] = newval;
+
+    if (!traceTable.first[METRIC_SSTH][slot])
+    {
+        WriteSample(slot, METRIC_SSTH, false, traceTable.ssThreshValue[slot]);
+    }
+}
+
+/**
+ * Slow start threshold tracer.
+ *
+ * @param slot Flow slot.
+ * @param oldval Old value.
+ * @param newval New value.
+ */
+static void
+SsThreshTracer(uint32_t slot, uint32_t oldval, uint32_t newval)
+{
+    if (traceTable.first[METRIC_SSTH][slot])
+    {
+        WriteSample(slot, METRIC_SSTH, true, oldval);
+        traceTable.first[METRIC_SSTH][slot] = false;
+    }
+    WriteSample(slot, METRIC_SSTH, false, newval);
+    traceTable.ssThreshValue[slot] = newval;
+
+    if (!traceTable.first[METRIC_CWND][slot])
+    {
+        WriteSample(slot, METRIC_CWND, false, traceTable.cWndValue[slot]);
+    }
+}
+
+/**
+ * RTT tracer.
+ *
+ * @param slot Flow slot.
+ * @param oldval Old value.
+ * @param newval New value.
+ */
+static void
+RttTracer(uint32_t slot, Time oldval, Time newval)
+{
+    if (traceTable.first[METRIC_RTT][slot])
+    {
+        WriteSample(slot, METRIC_RTT, true, oldval.GetSeconds());
+        traceTable.first[METRIC_RTT][slot] = false;
+    }
+    WriteSample(slot, METRIC_RTT, false, newval.GetSeconds());
+}
+
+/**
+ * RTO tracer.
+ *
+ * @param slot Flow slot.
+ * @param oldval Old value.
+ * @param newval New value.
+ */
+static void
+RtoTracer(uint32_t slot, Time oldval, Time newval)
+{
+    if (traceTable.first[METRIC_RTO][slot])
+    {
+        WriteSample(slot, METRIC_RTO, true, oldval.GetSeconds());
+        traceTable.first[METRIC_RTO][slot] = false;
+    }
+    WriteSample(slot, METRIC_RTO, false, newval.GetSeconds());
+}
+
+/**
+ * Next TX tracer.
+ *
+ * @param slot Flow slot.
+ * @param old Old sequence number.
+ * @param nextTx Next sequence number.
+ */
+static void
+NextTxTracer(uint32_t slot, SequenceNumber32 old [[maybe_unused]], SequenceNumber32 nextTx)
+{
+    WriteSample(slot, METRIC_NEXT_TX, false, nextTx);
+}
+
+/**
+ * In-flight tracer.
+ *
+ * @param slot Flow slot.
+ * @param old Old value.
+ * @param inFlight In flight value.
+ */
+static void
+InFlightTracer(uint32_t slot, uint32_t old [[maybe_unused]], uint32_t inFlight)
+{
+    WriteSample(slot, METRIC_INFLIGHT, false, inFlight);
+}
+
+/**
+ * Next RX tracer.
+ *
+ * @param slot Flow slot.
+ * @param old Old sequence number.
+ * @param nextRx Next sequence number.
+ */
+static void
+NextRxTracer(uint32_t slot, SequenceNumber32 old [[maybe_unused]], SequenceNumber32 nextRx)
+{
+    WriteSample(slot, METRIC_NEXT_RX, false, nextRx);
+}
+
+/**
+ * Connect the tracers of a flow to its BulkSend socket. Must run after
+ * Application::StartApplication, which creates the socket.
+ *
+ * @param source BulkSend application of the flow.
+ * @param slot Flow slot.
+ */
+static void
+HookSender(Ptr<BulkSendApplication> source, uint32_t slot)
+{
+    Ptr<Socket> socket = source->GetSocket();
+    NS_ASSERT_MSG(socket, "BulkSendApplication sem socket apos o inicio");
+    socket->TraceConnectWithoutContext("CongestionWindow", MakeBoundCallback(&CwndTracer, slot));
+    socket->TraceConnectWithoutContext("SlowStartThreshold",
+                                       MakeBoundCallback(&SsThreshTracer, slot));
+    socket->TraceConnectWithoutContext("RTT", MakeBoundCallback(&RttTracer, slot));
+    socket->TraceConnectWithoutContext("RTO", MakeBoundCallback(&RtoTracer, slot));
+    socket->TraceConnectWithoutContext("NextTxSequence", MakeBoundCallback(&NextTxTracer, slot));
+    socket->TraceConnectWithoutContext("BytesInFlight", MakeBoundCallback(&InFlightTracer, slot));
+}
+
+/**
+ * Schedule HookSender at the start time of the application.
+ *
+ * Runs at time zero, after Node::Initialize has scheduled
+ * Application::StartApplication, so the hook is queued right behind it at the
+ * same timestamp and sees the socket as soon as it exists.
+ *
+ * @param source BulkSend application of the flow.
+ * @param slot Flow slot.
+ * @param start Start time of the application.
+ */
+static void
+ScheduleSenderHook(Ptr<BulkSendApplication> source, uint32_t slot, Time start)
+{
+    Simulator::Schedule(start - Simulator::Now(), &HookSender, source, slot);
+}
+
+/**
+ * Sink Rx callback that hooks the sink-side socket of a flow once the
+ * connection has been accepted.
+ *
+ * @param slot Flow slot.
+ * @param packet Received packet.
+ * @param from Sender address.
+ */
+static void
+SinkRxHook(uint32_t slot,
+           Ptr<const Packet> packet [[maybe_unused]],
+           const Address& from [[maybe_unused]])
+{
+    if (traceTable.sinkHooked[slot])
+    {
+        return;
+    }
+    for (Ptr<Socket> socket : traceTable.sink[slot]->GetAcceptedSockets())
+    {
+        Ptr<TcpRxBuffer> rxBuffer = DynamicCast<TcpSocketBase>(socket)->GetRxBuffer();
+        WriteSample(slot, METRIC_NEXT_RX, false, rxBuffer->NextRxSequence());
+        rxBuffer->TraceConnectWithoutContext("NextRxSequence",
+                                             MakeBoundCallback(&NextRxTracer, slot));
+    }
+    traceTable.sinkHooked[slot] = true;
+}
+
+/**
+ * Trace both ends of a flow: the BulkSend socket as soon as the application
+ * creates it, and the sink-side socket as soon as it is accepted.
+ *
+ * @param source BulkSend application of the flow.
+ * @param sourceStart Start time of the BulkSend application.
+ * @param sink PacketSink application of the flow.
+ */
+static void
+TraceFlow(Ptr<Application> source, Time sourceStart, Ptr<Application> sink)
+{
+    Ptr<PacketSink> sinkApp = DynamicCast<PacketSink>(sink);
+    uint32_t slot = traceTable.Add(source->GetNode()->GetId(), sinkApp);
+    Simulator::Schedule(Seconds(0),
+                        &ScheduleSenderHook,
+                        DynamicCast<BulkSendApplication>(source),
+                        slot,
+                        sourceStart);
+    sinkApp->TraceConnectWithoutContext("Rx", MakeBoundCallback(&SinkRxHook, slot));
+}
+
+/**
+ * Escape a string for a JSON document.
+ *
+ * @param text The string.
+ * @return the quoted, escaped string.
+ */
+static std::string
+JsonString(const std::string& text)
+{
+    std::string out = "\"";
+    for (char c : text)
+    {
+        switch (c)
+        {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out += escaped;
+            }
+            else
+            {
+                out += c;
+            }
+        }
+    }
+    return out + "\"";
+}
+
+/**
+ * One JSON object, built field by field on a single line.
+ *
+ * JSON has no infinity or NaN, so every number goes through Number(), which
+ * writes non-finite values as null.
+ */
+class JsonObject
+{
+  public:
+    JsonObject()
+    {
+        m_out.precision(12);
+    }
+
+    /**
+     * Add a numeric or boolean field.
+     *
+     * @param key Field name.
+     * @param value Field value.
+     * @return this object.
+     */
+    template <typename T>
+    JsonObject& Field(const std::string& key, T value)
+    {
+        Key(key);
+        Number(value);
+        return *this;
+    }
+
+    /**
+     * Add a string field.
+     *
+     * @param key Field name.
+     * @param value Field value.
+     * @return this object.
+     */
+    JsonObject& Field(const std::string& key, const std::string& value)
+    {
+        Key(key);
+        m_out << JsonString(value);
+        return *this;
+    }
+
+    /**
+     * Add a string field.
+     *
+     * @param key Field name.
+     * @param value Field value.
+     * @return this object.
+     */
+    JsonObject& Field(const std::string& key, const char* value)
+    {
+        return Field(key, std::string(value));
+    }
+
+    /**
+     * Add a time field, in seconds.
+     *
+     * @param key Field name.
+     * @param value Field value.
+     * @return this object.
+     */
+    JsonObject& Field(const std::string& key, Time value)
+    {
+        return Field(key, value.GetSeconds());
+    }
+
+    /**
+     * Add an array of numbers.
+     *
+     * @param key Field name.
+     * @param values Array elements.
+     * @return this object.
+     */
+    template <typename T>
+    JsonObject& Array(const std::string& key, const std::vector<T>& values)
+    {
+        Key(key);
+        m_out << "[";
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            m_out << (i ? "," : "");
+            Number(values[i]);
+        }
+        m_out << "]";
+        return *this;
+    }
+
+    /**
+     * Add a nested object.
+     *
+     * @param key Field name.
+     * @param value The object.
+     * @return this object.
+     */
+    JsonObject& Object(const std::string& key, const JsonObject& value)
+    {
+        Key(key);
+        m_out << value.Str();
+        return *this;
+    }
+
+    /**
+     * @return the object as JSON text.
+     */
+    std::string Str() const
+    {
+        return "{" + m_out.str() + "}";
+    }
+
+  private:
+    /**
+     * Write a field name and its separator.
+     *
+     * @param key Field name.
+     */
+    void Key(const std::string& key)
+    {
+        m_out << (m_empty ? "" : ",") << JsonString(key) << ":";
+        m_empty = false;
+    }
+
+    /**
+     * Write a number or a boolean; null for infinities and NaN.
+     *
+     * @param value The value.
+     */
+    template <typename T>
+    void Number(T value)
+    {
+        if constexpr (std::is_same_v<T, bool>)
+        {
+            m_out << (value ? "true" : "false");
+        }
+        else if constexpr (std::is_floating_point_v<T>)
+        {
+            if (std::isfinite(value))
+            {
+                m_out << value;
+            }
+            else
+            {
+                m_out << "null";
+            }
+        }
+        else
+        {
+            m_out << +value;
+        }
+    }
+
+    std::ostringstream m_out; //!< Fields written so far.
+    bool m_empty{true};       //!< No field written yet.
+};
+
+/**
+ * Read a numeric field of the outer object of a JSON record.
+ *
+ * Strings, nested objects and arrays are skipped, so a field of the same name
+ * inside params or any other member does not match.
+ *
+ * @param json The record.
+ * @param key Field name (without escapes).
+ * @return the value, or NaN if the field is missing, null or not a number.
+ */
+inline double
+JsonNumberField(const std::string& json, const std::string& key)
+{
+    const double missing = std::numeric_limits<double>::quiet_NaN();
+    int depth = 0;
+    for (size_t i = 0; i < json.size(); ++i)
+    {
+        char c = json[i];
+        if (c == '{' || c == '[')
+        {
+            depth++;
+        }
+        else if (c == '}' || c == ']')
+        {
+            depth--;
+        }
+        else if (c == '"')
+        {
+            size_t start = ++i;
+            while (i < json.size() && json[i] != '"')
+            {
+                i += json[i] == '\\' ? 2 : 1;
+            }
+            if (i >= json.size())
+            {
+                break;
+            }
+            size_t colon = json.find_first_not_of(" \t\r\n", i + 1);
+            if (depth == 1 && colon != std::string::npos && json[colon] == ':' &&
+                json.compare(start, i - start, key) == 0)
+            {
+                const char* value = json.c_str() + colon + 1;
+                char* end = nullptr;
+                double number = std::strtod(value, &end);
+                return end == value ? missing : number;
+            }
+        }
+    }
+    return missing;
+}
+
+/**
+ * Machine-readable result records, one JSON object per line and per run.
+ *
+ * The target is a file name, "-" for stdout or "fd:N" for an inherited
+ * descriptor. Each record is flushed as soon as its run finishes, so a run
+ * that crashes simply has no record.
+ */
+class ResultWriter
+{
+  public:
+    /**
+     * Open the target.
+     *
+     * @param target File name, "-" or "fd:N".
+     */
+    void Open(const std::string& target)
+    {
+        if (target == "-")
+        {
+            m_file = stdout;
+        }
+        else if (target.rfind("fd:", 0) == 0)
+        {
+            m_file = fdopen(std::stoi(target.substr(3)), "w");
+        }
+        else
+        {
+            m_file = std::fopen(target.c_str(), "w");
+        }
+        if (!m_file)
+        {
+            NS_FATAL_ERROR("Nao foi possivel abrir o arquivo de resultados " << target);
+        }
+    }
+
+    /**
+     * @return true if a target is open.
+     */
+    bool IsOpen() const
+    {
+        return m_file != nullptr;
+    }
+
+    /**
+     * Write one record.
+     *
+     * @param record The formatted record, newline included.
+     */
+    void WriteRecord(const std::string& record)
+    {
+        std::fwrite(record.data(), 1, record.size(), m_file);
+        std::fflush(m_file);
+    }
+
+    /**
+     * Close the target.
+     */
+    void Close()
+    {
+        if (m_file && m_file != stdout)
+        {
+            std::fclose(m_file);
+        }
+        m_file = nullptr;
+    }
+
+  private:
+    FILE* m_file{nullptr}; //!< Open target.
+};
+
+static ResultWriter resultWriter; //!< Result records (resultFile).
+
+/**
+ * Summary of one metric over the replications of a configuration.
+ */
+struct Summary
+{
+    uint32_t n{0};     //!< Number of replications.
+    double mean{0};    //!< Sample mean.
+    double stddev{0};  //!< Sample standard deviation.
+    double ci95{0};    //!< Half-width of the 95% confidence interval of the mean.
+};
+
+/**
+ * Two-sided 97.5% quantile of Student's t distribution.
+ *
+ * @param df Degrees of freedom.
+ * @return the quantile.
+ */
+static double
+StudentT975(uint32_t df)
+{
+    static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306,
+                                   2.262,  2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120,
+                                   2.110,  2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064,
+                                   2.060,  2.056, 2.052, 2.048, 2.045, 2.042};
+    if (df == 0)
+    {
+        return 0;
+    }
+    if (df <= 30)
+    {
+        return table[df - 1];
+    }
+    return df <= 60 ? 2.000 : (df <= 120 ? 1.980 : 1.960);
+}
+
+/**
+ * Mean, standard deviation and 95% confidence interval of a set of samples.
+ *
+ * @param samples The samples.
+ * @return the summary.
+ */
+static Summary
+Summarize(const std::vector<double>& samples)
+{
+    Summary s;
+    s.n = samples.size();
+    if (s.n == 0)
+    {
+        return s;
+    }
+    for (double x : samples)
+    {
+        s.mean += x;
+    }
+    s.mean /= s.n;
+    if (s.n > 1)
+    {
+        double squares = 0;
+        for (double x : samples)
+        {
+            squares += (x - s.mean) * (x - s.mean);
+        }
+        s.stddev = std::sqrt(squares / (s.n - 1));
+        s.ci95 = StudentT975(s.n - 1) * s.stddev / std::sqrt(s.n);
+    }
+    return s;
+}
+
+/**
+ * Parse a comma-separated list of seeds.
+ *
+ * @param list The list, e.g. "1,2,3".
+ * @return the seeds.
+ */
+static std::vector<uint32_t>
+ParseSeeds(const std::string& list)
+{
+    std::vector<uint32_t> seeds;
+    std::istringstream in(list);
+    std::string item;
+    while (std::getline(in, item, ','))
+    {
+        if (!item.empty())
+        {
+            seeds.push_back(std::stoul(item));
+        }
+    }
+    return seeds;
+}
+
+/**
+ * Batch-means convergence test on the per-flow goodput.
+ *
+ * After a warm-up interval the rx byte counters of the sinks are sampled once
+ * per batch. Each batch gives one goodput sample per flow, and the run stops
+ * as soon as the 95% confidence interval of every flow's batch mean is within
+ * the tolerance, relative to that mean. The goodput is then measured over the
+ * interval between the end of the warm-up and the stop, excluding slow start.
+ */
+class ConvergenceMonitor
+{
+  public:
+    /**
+     * Start sampling.
+     *
+     * @param sinks Sink of each flow.
+     * @param warmupEnd Time the first batch starts at.
+     * @param batch Batch length.
+     * @param tolerance Relative half-width of the confidence interval to reach.
+     * @param minBatches Batches required before the test is applied.
+     */
+    void Start(const std::vector<Ptr<PacketSink>>& sinks,
+               Time warmupEnd,
+               Time batch,
+               double tolerance,
+               uint32_t minBatches)
+    {
+        m_sinks = sinks;
+        m_batch = batch;
+        m_tolerance = tolerance;
+        m_minBatches = std::max<uint32_t>(minBatches, 2);
+        m_baseRx.assign(sinks.size(), 0);
+        m_lastRx.assign(sinks.size(), 0);
+        m_samples.assign(sinks.size(), std::vector<double>());
+        m_precision = std::numeric_limits<double>::infinity();
+        m_converged = false;
+        m_enabled = true;
+        Simulator::Schedule(warmupEnd - Simulator::Now(), &ConvergenceMonitor::Begin, this);
+    }
+
+    /**
+     * @return true if Start was called.
+     */
+    bool IsEnabled() const
+    {
+        return m_enabled;
+    }
+
+    /**
+     * Close the measurement interval at the current time.
+     */
+    void Finish()
+    {
+        m_end = Simulator::Now();
+    }
+
+    /**
+     * @param flow The flow.
+     * @return bytes received by the flow within the measurement interval.
+     */
+    uint64_t RxBytes(uint32_t flow) const
+    {
+        return m_sinks[flow]->GetTotalRx() - m_baseRx[flow];
+    }
+
+    /**
+     * @return length of the measurement interval, in seconds.
+     */
+    double MeasuredSeconds() const
+    {
+        return (m_end - m_begin).GetSeconds();
+    }
+
+    /**
+     * @return worst relative half-width of the flows' confidence intervals;
+     *         infinity until minBatches batches are complete, or while a flow
+     *         has no goodput.
+     */
+    double Precision() const
+    {
+        return m_precision;
+    }
+
+    /**
+     * @return true if the tolerance was reached before the time cap.
+     */
+    bool Converged() const
+    {
+        return m_converged;
+    }
+
+    /**
+     * @return number of complete batches.
+     */
+    uint32_t Batches() const
+    {
+        return m_samples.empty() ? 0 : m_samples[0].size();
+    }
+
+  private:
+    /**
+     * End of the warm-up: take the base counters and start the first batch.
+     */
+    void Begin()
+    {
+        m_begin = Simulator::Now();
+        m_end = m_begin;
+        for (size_t i = 0; i < m_sinks.size(); ++i)
+        {
+            m_baseRx[i] = m_sinks[i]->GetTotalRx();
+            m_lastRx[i] = m_baseRx[i];
+        }
+        Simulator::Schedule(m_batch, &ConvergenceMonitor::Sample, this);
+    }
+
+    /**
+     * End of a batch: add one sample per flow and apply the test.
+     */
+    void Sample()
+    {
+        double batchSeconds = m_batch.GetSeconds();
+        for (size_t i = 0; i < m_sinks.size(); ++i)
+        {
+            uint64_t rx = m_sinks[i]->GetTotalRx();
+            m_samples[i].push_back((rx - m_lastRx[i]) * 8.0 / batchSeconds);
+            m_lastRx[i] = rx;
+        }
+        if (Batches() >= m_minBatches)
+        {
+            m_precision = 0;
+            for (const auto& samples : m_samples)
+            {
+                Summary s = Summarize(samples);
+                // Um fluxo sem goodput nunca converge; so o limite de tempo encerra a rodada
+                double relative =
+                    s.mean > 0 ? s.ci95 / s.mean : std::numeric_limits<double>::infinity();
+                m_precision = std::max(m_precision, relative);
+            }
+            if (m_precision <= m_tolerance)
+            {
+                m_converged = true;
+                Simulator::Stop();
+                return;
+            }
+        }
+        Simulator::Schedule(m_batch, &ConvergenceMonitor::Sample, this);
+    }
+
+    std::vector<Ptr<PacketSink>> m_sinks;       //!< Sink of each flow.
+    std::vector<uint64_t> m_baseRx;             //!< Rx bytes at the end of the warm-up.
+    std::vector<uint64_t> m_lastRx;             //!< Rx bytes at the start of the current batch.
+    std::vector<std::vector<double>> m_samples; //!< Batch goodputs of each flow.
+    Time m_batch;                               //!< Batch length.
+    Time m_begin;                               //!< Start of the measurement interval.
+    Time m_end;                                 //!< End of the measurement interval.
+    double m_tolerance{0};                      //!< Relative half-width to reach.
+    uint32_t m_minBatches{2};                   //!< Batches before the test is applied.
+    double m_precision{0};                      //!< Current worst relative half-width.
+    bool m_converged{false};                    //!< Tolerance reached.
+    bool m_enabled{false};                      //!< Start was called.
+};
+
+/**
+ * Per-flow goodput statistics collected online from the sinks' Rx traces.
+ *
+ * Rx only adds the packet size to the current bin of its flow. Once per bin a
+ * tick moves the bins into preallocated ring buffers (the last @c bins bins of
+ * every flow are kept) and updates the per-bin Jain's fairness index. The
+ * totals give the overall Jain's index, each flow's share of the bottleneck
+ * and the goodput imbalance between the RTT classes.
+ */
+class FlowStats
+{
+  public:
+    /**
+     * Start collecting.
+     *
+     * @param sinks Sink of each flow.
+     * @param rttClass RTT class of each flow (0 = fast path, 1 = slow path).
+     * @param start Time the flows start.
+     * @param bin Bin width.
+     * @param bins Ring buffer capacity, in bins.
+     * @param bottleneckBps Bottleneck rate, in bps.
+     */
+    void Start(const std::vector<Ptr<PacketSink>>& sinks,
+               const std::vector<uint8_t>& rttClass,
+               Time start,
+               Time bin,
+               uint32_t bins,
+               double bottleneckBps);
+
+    /**
+     * @return true if Start was called.
+     */
+    bool IsEnabled() const
+    {
+        return m_enabled;
+    }
+
+    /**
+     * Account one received packet.
+     *
+     * @param flow The flow.
+     * @param bytes Packet size.
+     */
+    void Add(uint32_t flow, uint32_t bytes)
+    {
+        m_binBytes[flow] += bytes;
+        m_totalBytes[flow] += bytes;
+    }
+
+    /**
+     * Change the rate the shares are measured against (forkAt dataRate variants).
+     *
+     * @param bottleneckBps Bottleneck rate, in bps.
+     */
+    void SetBottleneck(double bottleneckBps)
+    {
+        m_bottleneckBps = bottleneckBps;
+    }
+
+    /**
+     * Close the partial bin and the measurement interval at the current time.
+     */
+    void Finish();
+
+    /**
+     * @param flow The flow.
+     * @return goodput of the flow over the measurement interval, in bps.
+     */
+    double Goodput(uint32_t flow) const
+    {
+        return m_totalBytes[flow] * 8.0 / (m_end - m_start).GetSeconds();
+    }
+
+    /**
+     * @param flow The flow.
+     * @return fraction of the bottleneck rate the flow obtained.
+     */
+    double Share(uint32_t flow) const
+    {
+        return Goodput(flow) / m_bottleneckBps;
+    }
+
+    /**
+     * @return Jain's fairness index of the per-flow goodput.
+     */
+    double Jain() const
+    {
+        return JainIndex(m_totalBytes);
+    }
+
+    /**
+     * @return mean of the Jain's index over the bins with traffic.
+     */
+    double MeanBinJain() const
+    {
+        return m_jainBins ? m_jainSum / m_jainBins : 0;
+    }
+
+    /**
+     * @return lowest Jain's index of a bin with traffic.
+     */
+    double MinBinJain() const
+    {
+        return m_jainBins ? m_jainMin : 0;
+    }
+
+    /**
+     * @param rttClass The RTT class.
+     * @return average per-flow goodput of the class, in bps.
+     */
+    double ClassGoodput(uint8_t rttClass) const;
+
+    /**
+     * @return average goodput of the fast class over that of the slow class,
+     *         0 with a single class, or infinity when the slow class got no
+     *         goodput at all (null in the result record).
+     */
+    double ClassImbalance() const;
+
+    /**
+     * Write the ring buffers as "time flow goodput" lines.
+     *
+     * @param fileName Output file.
+     */
+    void WriteSeries(const std::string& fileName) const;
+
+  private:
+    /**
+     * Jain's fairness index of a set of per-flow amounts.
+     *
+     * @param amounts The amounts.
+     * @return the index, or 0 if all amounts are 0.
+     */
+    template <typename T>
+    static double JainIndex(const std::vector<T>& amounts)
+    {
+        double sum = 0;
+        double squares = 0;
+        for (T x : amounts)
+        {
+            sum += x;
+            squares += static_cast<double>(x) * x;
+        }
+        return squares > 0 ? sum * sum / (amounts.size() * squares) : 0;
+    }
+
+    /**
+     * End of a bin: move it into the ring buffers and schedule the next one.
+     */
+    void Tick();
+
+    /**
+     * Move the current bins into the ring buffers.
+     *
+     * @param binSeconds Length of the bin, in seconds.
+     */
+    void CloseBin(double binSeconds);
+
+    std::vector<uint64_t> m_binBytes;   //!< Bytes of each flow in the current bin.
+    std::vector<uint64_t> m_totalBytes; //!< Bytes of each flow since the start.
+    std::vector<uint8_t> m_rttClass;    //!< RTT class of each flow.
+    std::vector<double> m_series;       //!< Ring buffers, bin-major (bins x flows), in bps.
+    std::vector<double> m_binEnd;       //!< End time of each ring slot, in seconds.
+    uint32_t m_bins{0};                 //!< Ring capacity.
+    uint32_t m_head{0};                 //!< Next ring slot.
+    uint32_t m_filled{0};               //!< Ring slots in use.
+    Time m_bin;                         //!< Bin width.
+    Time m_start;                       //!< Start of the measurement interval.
+    Time m_end;                         //!< End of the measurement interval.
+    Time m_binStart;                    //!< Start of the current bin.
+    double m_bottleneckBps{0};          //!< Bottleneck rate.
+    double m_jainSum{0};                //!< Sum of the per-bin Jain's indexes.
+    double m_jainMin{1};                //!< Lowest per-bin Jain's index.
+    uint32_t m_jainBins{0};             //!< Bins with traffic.
+    EventId m_tick;                     //!< Next bin tick.
+    bool m_enabled{false};              //!< Start was called.
+};
+
+static FlowStats flowStats; //!< Per-flow goodput statistics (flowStats option).
+
+/**
+ * Rx trace of a sink: account the packet to its flow.
+ *
+ * @param flow The flow.
+ * @param packet The received packet.
+ * @param from Sender address.
+ */
+static void
+FlowStatsRx(uint32_t flow, Ptr<const Packet> packet, const Address& from [[maybe_unused]])
+{
+    flowStats.Add(flow, packet->GetSize());
+}
+
+inline void
+FlowStats::Start(const std::vector<Ptr<PacketSink>>& sinks,
+                 const std::vector<uint8_t>& rttClass,
+                 Time start,
+                 Time bin,
+                 uint32_t bins,
+                 double bottleneckBps)
+{
+    uint32_t flows = sinks.size();
+    m_binBytes.assign(flows, 0);
+    m_totalBytes.assign(flows, 0);
+    m_rttClass = rttClass;
+    m_bins = std::max<uint32_t>(bins, 1);
+    m_series.assign(static_cast<size_t>(m_bins) * flows, 0);
+    m_binEnd.assign(m_bins, 0);
+    m_head = 0;
+    m_filled = 0;
+    m_bin = bin;
+    m_start = start;
+    m_end = start;
+    m_binStart = start;
+    m_bottleneckBps = bottleneckBps;
+    m_jainSum = 0;
+    m_jainMin = 1;
+    m_jainBins = 0;
+    m_enabled = true;
+    for (uint32_t flow = 0; flow < flows; ++flow)
+    {
+        sinks[flow]->TraceConnectWithoutContext("Rx", MakeBoundCallback(&FlowStatsRx, flow));
+    }
+    m_tick = Simulator::Schedule(start + bin - Simulator::Now(), &FlowStats::Tick, this);
+}
+
+inline void
+FlowStats::Tick()
+{
+    CloseBin(m_bin.GetSeconds());
+    m_binStart = Simulator::Now();
+    m_tick = Simulator::Schedule(m_bin, &FlowStats::Tick, this);
+}
+
+inline void
+FlowStats::CloseBin(double binSeconds)
+{
+    double* slot = &m_series[static_cast<size_t>(m_head) * m_binBytes.size()];
+    for (size_t flow = 0; flow < m_binBytes.size(); ++flow)
+    {
+        slot[flow] = m_binBytes[flow] * 8.0 / binSeconds;
+    }
+    m_binEnd[m_head] = Simulator::Now().GetSeconds();
+    m_head = (m_head + 1) % m_bins;
+    m_filled = std::min(m_filled + 1, m_bins);
+
+    double jain = JainIndex(m_binBytes);
+    if (jain > 0)
+    {
+        m_jainSum += jain;
+        m_jainMin = std::min(m_jainMin, jain);
+        m_jainBins++;
+    }
+    std::fill(m_binBytes.begin(), m_binBytes.end(), 0);
+}
+
+inline void
+FlowStats::Finish()
+{
+    m_tick.Cancel();
+    m_end = Simulator::Now();
+    double partial = (m_end - m_binStart).GetSeconds();
+    if (partial > 0)
+    {
+        CloseBin(partial);
+    }
+}
+
+inline double
+FlowStats::ClassGoodput(uint8_t rttClass) const
+{
+    double sum = 0;
+    uint32_t flows = 0;
+    for (size_t flow = 0; flow < m_totalBytes.size(); ++flow)
+    {
+        if (m_rttClass[flow] == rttClass)
+        {
+            sum += Goodput(flow);
+            flows++;
+        }
+    }
+    return flows ? sum / flows : 0;
+}
+
+inline double
+FlowStats::ClassImbalance() const
+{
+    if (std::find(m_rttClass.begin(), m_rttClass.end(), 1) == m_rttClass.end())
+    {
+        return 0;
+    }
+    double slow = ClassGoodput(1);
+    return slow > 0 ? ClassGoodput(0) / slow : std::numeric_limits<double>::infinity();
+}
+
+inline void
+FlowStats::WriteSeries(const std::string& fileName) const
+{
+    std::ofstream out(fileName);
+    uint32_t first = (m_head + m_bins - m_filled) % m_bins;
+    for (uint32_t i = 0; i < m_filled; ++i)
+    {
+        uint32_t slot = (first + i) % m_bins;
+        for (size_t flow = 0; flow < m_binBytes.size(); ++flow)
+        {
+            out << m_binEnd[slot] << " " << flow << " "
+                << m_series[static_cast<size_t>(slot) * m_binBytes.size() + flow] << "\n";
+        }
+    }
+}
+
+/**
+ * Send time a data packet carries from the source to the sink (monitor=edge).
+ */
+class EdgeTimestampTag : public Tag
+{
+  public:
+    /**
+     * @brief Get the type ID.
+     * @return the object TypeId
+     */
+    static TypeId GetTypeId()
+    {
+        static TypeId tid =
+            TypeId("EdgeTimestampTag").SetParent<Tag>().AddConstructor<EdgeTimestampTag>();
+        return tid;
+    }
+
+    TypeId GetInstanceTypeId() const override
+    {
+        return GetTypeId();
+    }
+
+    uint32_t GetSerializedSize() const override
+    {
+        return sizeof(int64_t);
+    }
+
+    void Serialize(TagBuffer buf) const override
+    {
+        buf.WriteU64(static_cast<uint64_t>(m_sent));
+    }
+
+    void Deserialize(TagBuffer buf) override
+    {
+        m_sent = static_cast<int64_t>(buf.ReadU64());
+    }
+
+    void Print(std::ostream& os) const override
+    {
+        os << "sent=" << m_sent << "ns";
+    }
+
+    /**
+     * @param sent Send time.
+     */
+    void SetSent(Time sent)
+    {
+        m_sent = sent.GetNanoSeconds();
+    }
+
+    /**
+     * @return the send time.
+     */
+    Time GetSent() const
+    {
+        return NanoSeconds(m_sent);
+    }
+
+  private:
+    int64_t m_sent{0}; //!< Send time, in ns.
+};
+
+/**
+ * Per-flow counters of the edge monitor.
+ */
+struct EdgeFlowCounters
+{
+    uint64_t txBytes{0};   //!< IP bytes sent by the source.
+    uint64_t rxBytes{0};   //!< IP bytes delivered to the sink.
+    uint32_t txPackets{0}; //!< Packets sent by the source.
+    uint32_t rxPackets{0}; //!< Packets delivered to the sink.
+    int64_t delaySum{0};   //!< Sum of the one-way delays, in ns.
+    int64_t delayMax{0};   //!< Largest one-way delay, in ns.
+};
+
+/**
+ * Lightweight alternative to FlowMonitor (monitor=edge).
+ *
+ * Only the IPv4 layer of the source and sink nodes is hooked: data packets are
+ * stamped on SendOutgoing and matched on LocalDeliver, and each flow keeps a
+ * fixed set of counters, with no histograms, no per-probe state and no
+ * classifier table. Packets still in flight when the run stops count as lost,
+ * as in FlowMonitor before its loss timeout.
+ */
+class EdgeMonitor
+{
+  public:
+    /**
+     * Hook the source and sink nodes.
+     *
+     * @param sources Nodes the flows start at.
+     * @param sinks Nodes the flows end at.
+     * @param portBase Port of flow 0.
+     * @param flows Number of flows.
+     * @param bySourcePort Tell flows apart by TCP source port instead of
+     *                     destination port.
+     */
+    void Start(const NodeContainer& sources,
+               const NodeContainer& sinks,
+               uint16_t portBase,
+               uint32_t flows,
+               bool bySourcePort);
+
+    /**
+     * @return true if Start was called.
+     */
+    bool IsEnabled() const
+    {
+        return m_enabled;
+    }
+
+    /**
+     * @return counters of every flow.
+     */
+    const std::vector<EdgeFlowCounters>& Flows() const
+    {
+        return m_flows;
+    }
+
+    /**
+     * @return bytes of monitor state per flow.
+     */
+    static uint32_t BytesPerFlow()
+    {
+        return sizeof(EdgeFlowCounters);
+    }
+
+    /**
+     * Write one "flow,txBytes,rxBytes,txPackets,rxPackets,lost,delaySum,delayMax"
+     * line per flow (delays in seconds).
+     *
+     * @param fileName Output file.
+     */
+    void WriteCsv(const std::string& fileName) const;
+
+  private:
+    /**
+     * Flow of a TCP packet.
+     *
+     * @param header IPv4 header of the packet.
+     * @param packet The packet, starting at the TCP header.
+     * @param flow Set to the flow.
+     * @return true if the packet belongs to a monitored flow.
+     */
+    bool FlowOf(const Ipv4Header& header, Ptr<const Packet> packet, uint32_t& flow) const;
+
+    /**
+     * SendOutgoing trace of a source node.
+     *
+     * @param header IPv4 header.
+     * @param packet The packet.
+     * @param interface Output interface.
+     */
+    void SourceTx(const Ipv4Header& header, Ptr<const Packet> packet, uint32_t interface);
+
+    /**
+     * LocalDeliver trace of a sink node.
+     *
+     * @param header IPv4 header.
+     * @param packet The packet.
+     * @param interface Input interface.
+     */
+    void SinkRx(const Ipv4Header& header, Ptr<const Packet> packet, uint32_t interface);
+
+    std::vector<EdgeFlowCounters> m_flows; //!< Counters of each flow.
+    uint16_t m_portBase{0};                //!< Port of flow 0.
+    bool m_bySourcePort{false};            //!< Flows told apart by source port.
+    bool m_enabled{false};                 //!< Start was called.
+};
+
+static EdgeMonitor edgeMonitor; //!< Per-flow edge counters (monitor=edge).
+
+inline void
+EdgeMonitor::Start(const NodeContainer& sources,
+                   const NodeContainer& sinks,
+                   uint16_t portBase,
+                   uint32_t flows,
+                   bool bySourcePort)
+{
+    m_flows.assign(flows, EdgeFlowCounters());
+    m_portBase = portBase;
+    m_bySourcePort = bySourcePort;
+    m_enabled = true;
+    for (auto it = sources.Begin(); it != sources.End(); ++it)
+    {
+        (*it)->GetObject<Ipv4L3Protocol>()->TraceConnectWithoutContext(
+            "SendOutgoing",
+            MakeCallback(&EdgeMonitor::SourceTx, this));
+    }
+    for (auto it = sinks.Begin(); it != sinks.End(); ++it)
+    {
+        (*it)->GetObject<Ipv4L3Protocol>()->TraceConnectWithoutContext(
+            "LocalDeliver",
+            MakeCallback(&EdgeMonitor::SinkRx, this));
+    }
+}
+
+inline bool
+EdgeMonitor::FlowOf(const Ipv4Header& header, Ptr<const Packet> packet, uint32_t& flow) const
+{
+    TcpHeader tcp;
+    if (header.GetProtocol() != TcpL4Protocol::PROT_NUMBER || packet->PeekHeader(tcp) == 0)
+    {
+        return false;
+    }
+    uint16_t port = m_bySourcePort ? tcp.GetSourcePort() : tcp.GetDestinationPort();
+    flow = static_cast<uint16_t>(port - m_portBase);
+    return flow < m_flows.size();
+}
+
+inline void
+EdgeMonitor::SourceTx(const Ipv4Header& header,
+                      Ptr<const Packet> packet,
+                      uint32_t interface [[maybe_unused]])
+{
+    uint32_t flow;
+    if (!FlowOf(header, packet, flow))
+    {
+        return;
+    }
+    EdgeTimestampTag tag;
+    tag.SetSent(Simulator::Now());
+    packet->AddPacketTag(tag);
+    m_flows[flow].txBytes += packet->GetSize() + header.GetSerializedSize();
+    m_flows[flow].txPackets++;
+}
+
+inline void
+EdgeMonitor::SinkRx(const Ipv4Header& header,
+                    Ptr<const Packet> packet,
+                    uint32_t interface [[maybe_unused]])
+{
+    uint32_t flow;
+    EdgeTimestampTag tag;
+    if (!FlowOf(header, packet, flow) || !packet->PeekPacketTag(tag))
+    {
+        return;
+    }
+    int64_t delay = (Simulator::Now() - tag.GetSent()).GetNanoSeconds();
+    EdgeFlowCounters& counters = m_flows[flow];
+    counters.rxBytes += packet->GetSize() + header.GetSerializedSize();
+    counters.rxPackets++;
+    counters.delaySum += delay;
+    counters.delayMax = std::max(counters.delayMax, delay);
+}
+
+inline void
+EdgeMonitor::WriteCsv(const std::string& fileName) const
+{
+    std::ofstream out(fileName);
+    out << "flow,txBytes,rxBytes,txPackets,rxPackets,lost,delaySum,delayMax\n";
+    for (size_t flow = 0; flow < m_flows.size(); ++flow)
+    {
+        const EdgeFlowCounters& c = m_flows[flow];
+        out << flow << "," << c.txBytes << "," << c.rxBytes << "," << c.txPackets << ","
+            << c.rxPackets << "," << c.txPackets - std::min(c.rxPackets, c.txPackets) << ","
+            << c.delaySum * 1e-9 << "," << c.delayMax * 1e-9 << "\n";
+    }
+}
+
+/**
+ * Estimate the state FlowMonitor keeps per flow (monitor=full): the flow
+ * statistics with their histograms, the per-probe statistics and the
+ * classifier entries, reverse (ACK) flows included.
+ *
+ * @param monitor The monitor.
+ * @param flows Number of application flows.
+ * @return bytes per application flow.
+ */
+static double
+FlowMonitorBytesPerFlow(Ptr<FlowMonitor> monitor, uint32_t flows)
+{
+    // Cabecalho de um no de std::map (cor, pai, filhos)
+    const size_t mapNode = 4 * sizeof(void*);
+    size_t bytes = 0;
+    for (const auto& [id, st] : monitor->GetFlowStats())
+    {
+        bytes += mapNode + sizeof(id) + sizeof(st);
+        bytes += (st.delayHistogram.GetNBins() + st.jitterHistogram.GetNBins() +
+                  st.packetSizeHistogram.GetNBins() + st.flowInterruptionsHistogram.GetNBins()) *
+                 sizeof(uint32_t);
+        bytes += st.packetsDropped.size() * sizeof(uint32_t) +
+                 st.bytesDropped.size() * sizeof(uint64_t);
+        bytes += mapNode + sizeof(Ipv4FlowClassifier::FiveTuple) + sizeof(FlowId);
+    }
+    for (const auto& probe : monitor->GetAllProbes())
+    {
+        for (const auto& [id, st] : probe->GetStats())
+        {
+            bytes += mapNode + sizeof(id) + sizeof(st);
+            bytes += st.packetsDropped.size() * sizeof(uint32_t) +
+                     st.bytesDropped.size() * sizeof(uint64_t);
+        }
+    }
+    return flows ? static_cast<double>(bytes) / flows : 0;
+}
+
+#endif /* LAB2_COMMON_H */
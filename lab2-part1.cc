@@ -22,6 +22,10 @@
  * ICST SIMUTools Workshop on ns-3 (WNS3), Cannes, France, March 2013
  */
 
+#include "lab-common.h"
+#include "lab-pcap.h"
+#include "lab2-common.h"
+
 #include "ns3/applications-module.h"
 #include "ns3/core-module.h"
 #include "ns3/enum.h"
@@ -29,6 +33,7 @@
 #include "ns3/event-id.h"
 #include "ns3/flow-monitor-helper.h"
 #include "ns3/internet-module.h"
+#include "ns3/ipv4-flow-classifier.h"
 #include "ns3/ipv4-global-routing-helper.h"
 #include "ns3/network-module.h"
 #include "ns3/point-to-point-module.h"
@@ -36,338 +41,1379 @@
 #include "ns3/traffic-control-module.h"
 #include "ns3/udp-header.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 using namespace ns3;
 
 NS_LOG_COMPONENT_DEFINE("TcpVariantsComparison");
 
-static std::map<uint32_t, bool> firstCwnd;                      //!< First congestion window.
-static std::map<uint32_t, bool> firstSshThr;                    //!< First SlowStart threshold.
-static std::map<uint32_t, bool> firstRtt;                       //!< First RTT.
-static std::map<uint32_t, bool> firstRto;                       //!< First RTO.
-static std::map<uint32_t, Ptr<OutputStreamWrapper>> cWndStream; //!< Congstion window output stream.
-static std::map<uint32_t, Ptr<OutputStreamWrapper>>
-    ssThreshStream; //!< SlowStart threshold output stream.
-static std::map<uint32_t, Ptr<OutputStreamWrapper>> rttStream;      //!< RTT output stream.
-static std::map<uint32_t, Ptr<OutputStreamWrapper>> rtoStream;      //!< RTO output stream.
-static std::map<uint32_t, Ptr<OutputStreamWrapper>> nextTxStream;   //!< Next TX output stream.
-static std::map<uint32_t, Ptr<OutputStreamWrapper>> nextRxStream;   //!< Next RX output stream.
-static std::map<uint32_t, Ptr<OutputStreamWrapper>> inFlightStream; //!< In flight output stream.
-static std::map<uint32_t, uint32_t> cWndValue;                      //!< congestion window value.
-static std::map<uint32_t, uint32_t> ssThreshValue;                  //!< SlowStart threshold value.
+static const char* const PROGRAM_NAME = "lab2-part1"; //!< Name in the result records.
 
 /**
- * Get the Node Id From Context.
- *
- * @param context The context.
- * @return the node ID.
+ * Parameters of one simulation run.
  */
-static uint32_t
-GetNodeIdFromContext(std::string context)
+struct SimConfig
 {
-    const std::size_t n1 = context.find_first_of('/', 1);
-    const std::size_t n2 = context.find_first_of('/', n1 + 1);
-    return std::stoul(context.substr(n1 + 1, n2 - n1 - 1));
-}
+    std::string transport_prot = "TcpCubic";                      //!< Transport protocol.
+    double errorRate = 0.00001;                                   //!< Bottleneck error rate.
+    std::string delay = "100ms";                                  //!< Bottleneck delay.
+    std::string dataRate = "10Mbps";                              //!< Bottleneck data rate.
+    uint32_t nFlows = 1;                                          //!< Number of flows.
+    uint32_t seed = 1;                                            //!< RNG seed.
+    uint32_t run = 0;                                             //!< RNG run number.
+    int64_t streamBase = 0;                                       //!< First explicit RNG stream.
+    std::string prefix = "scratch/resultados/Congestion_Control"; //!< Output file prefix.
+    double duration = 20.0;                                       //!< Simulated time of the flows (cap in convergence mode).
+    double convergeTolerance = 0;                                 //!< Relative CI half-width to stop at (0 = off).
+    Time convergeWarmup = Seconds(2);                             //!< Warm-up left out of the goodput.
+    Time convergeBatch = Seconds(1);                              //!< Batch length of the convergence test.
+    uint32_t convergeMinBatches = 5;                              //!< Batches before the test is applied.
+    bool flowStats = false;                                       //!< Collect per-flow goodput statistics.
+    Time flowStatsBin = MilliSeconds(100);                        //!< Bin width of the goodput time series.
+    uint32_t flowStatsBins = 1024;                                //!< Bins kept per flow.
+    std::string monitor = "full";                                 //!< Flow monitoring level (off, edge, full).
+    bool pcap = false;                                            //!< Capture pcap on every link.
+    bool pcapAsync = false;                                       //!< Capture from a background writer thread.
+    uint32_t pcapSnaplen = 128;                                   //!< Bytes kept of each packet (pcapAsync).
+    uint64_t pcapRotateBytes = 0;                                 //!< Pcap file size to rotate at (0 = no limit).
+    Time pcapRotateTime = Seconds(0);                             //!< Simulated time per pcap file (0 = no limit).
+    uint32_t pcapMaxFiles = 0;                                    //!< Pcap files kept per device (0 = all).
+    bool profile = false;                                         //!< Time the phases of the run.
+    std::string scheduler = "map";                                //!< Event scheduler.
+    std::string traceFormat = "text";                             //!< TCP trace sink.
+    bool traceCompress = false;                                   //!< Gzip the binary trace.
+    std::string traceMode = "full";                               //!< Trace reduction mode.
+    double traceThreshold = 0.05;                                 //!< Change mode threshold.
+    Time traceBucket = MilliSeconds(10);                          //!< Bucket mode width.
+    std::string ipTrace = "aggregate";                            //!< IPv4 tracing mode.
+    Time ipTraceInterval = MilliSeconds(100);                     //!< Snapshot interval (aggregate mode).
+    uint32_t ipTraceSample = 100;                                 //!< Events per record (sampled mode).
+    Time forkAt = Seconds(0);                                     //!< Time to fork the variants at (0 = off).
+    std::string forkVariants;                                     //!< Variants forked at forkAt.
+    uint32_t forkJobs = 0;                                        //!< Variants run at a time (0 = cores).
+};
 
 /**
- * Congestion window tracer.
- *
- * @param context The context.
- * @param oldval Old value.
- * @param newval New value.
+ * Results of one simulation run.
  */
-static void
-CwndTracer(std::string context, uint32_t oldval, uint32_t newval)
+struct RunResult
 {
-    uint32_t nodeId = GetNodeIdFromContext(context);
-
-    if (firstCwnd[nodeId])
-    {
-        *cWndStream[nodeId]->GetStream() << "0.0 " << oldval << std::endl;
-        firstCwnd[nodeId] = false;
-    }
-    *cWndStream[nodeId]->GetStream() << Simulator::Now().GetSeconds() << " " << newval << std::endl;
-    cWndValue[nodeId] = newval;
+    std::vector<uint64_t> rxBytes; //!< Bytes received by the sink of each flow.
+    double aggregateGoodput{0};    //!< Aggregate goodput, in bps.
+    double flowDuration{0};        //!< Interval the goodput is measured over, in seconds.
+    uint64_t events{0};            //!< Events executed by Simulator::Run.
+    double wallSeconds{0};         //!< Wall-clock time of Simulator::Run, in seconds.
+    double precision{0};           //!< Worst relative CI half-width reached (convergence mode).
+    double simulatedSeconds{0};    //!< Simulated time actually used, in seconds.
+    bool converged{false};         //!< Tolerance reached before the cap.
+    double jain{0};                //!< Jain's fairness index of the per-flow goodput (flowStats).
+    double meanBinJain{0};         //!< Mean per-bin Jain's index (flowStats).
+    std::vector<double> share;     //!< Fraction of the bottleneck each flow obtained (flowStats).
+    double rttImbalance{0};        //!< Fast-class over slow-class goodput (flowStats).
+    double monitorBytesPerFlow{0}; //!< Flow monitor state per flow, in bytes (monitor).
+
+    std::vector<std::pair<const char*, double>> phases; //!< Wall-clock time per phase (profile).
+};
 
-    if (!firstSshThr[nodeId])
-    {
-        *ssThreshStream[nodeId]->GetStream()
-            << Simulator::Now().GetSeconds() << " " << ssThreshValue[nodeId] << std::endl;
-    }
+/**
+ * Format the parameters of a run for its result record.
+ *
+ * @param cfg The configuration of the run.
+ * @return the params object.
+ */
+static JsonObject
+FormatParams(const SimConfig& cfg)
+{
+    JsonObject params;
+    params
+        .Field("transport_prot", cfg.transport_prot)
+        .Field("errorRate", cfg.errorRate)
+        .Field("delay", cfg.delay)
+        .Field("dataRate", cfg.dataRate)
+        .Field("nFlows", cfg.nFlows)
+        .Field("seed", cfg.seed)
+        .Field("run", cfg.run)
+        .Field("streamBase", cfg.streamBase)
+        .Field("prefix", cfg.prefix)
+        .Field("duration", cfg.duration)
+        .Field("convergeTolerance", cfg.convergeTolerance)
+        .Field("convergeWarmup", cfg.convergeWarmup)
+        .Field("convergeBatch", cfg.convergeBatch)
+        .Field("convergeMinBatches", cfg.convergeMinBatches)
+        .Field("flowStats", cfg.flowStats)
+        .Field("flowStatsBin", cfg.flowStatsBin)
+        .Field("flowStatsBins", cfg.flowStatsBins)
+        .Field("monitor", cfg.monitor)
+        .Field("pcap", cfg.pcap)
+        .Field("pcapAsync", cfg.pcapAsync)
+        .Field("pcapSnaplen", cfg.pcapSnaplen)
+        .Field("pcapRotateBytes", cfg.pcapRotateBytes)
+        .Field("pcapRotateTime", cfg.pcapRotateTime)
+        .Field("pcapMaxFiles", cfg.pcapMaxFiles)
+        .Field("profile", cfg.profile)
+        .Field("scheduler", cfg.scheduler)
+        .Field("traceFormat", cfg.traceFormat)
+        .Field("traceCompress", cfg.traceCompress)
+        .Field("traceMode", cfg.traceMode)
+        .Field("traceThreshold", cfg.traceThreshold)
+        .Field("traceBucket", cfg.traceBucket)
+        .Field("ipTrace", cfg.ipTrace)
+        .Field("ipTraceInterval", cfg.ipTraceInterval)
+        .Field("ipTraceSample", cfg.ipTraceSample)
+        .Field("forkAt", cfg.forkAt)
+        .Field("forkVariants", cfg.forkVariants)
+        .Field("forkJobs", cfg.forkJobs);
+    return params;
 }
 
 /**
- * Slow start threshold tracer.
+ * Format the result record of one run (resultFile).
  *
- * @param context The context.
- * @param oldval Old value.
- * @param newval New value.
+ * @param cfg The configuration of the run.
+ * @param prefix Prefix of the output files of the run.
+ * @param result The result of the run.
+ * @return the JSON record, newline included.
  */
-static void
-SsThreshTracer(std::string context, uint32_t oldval, uint32_t newval)
+static std::string
+FormatResult(const SimConfig& cfg, const std::string& prefix, const RunResult& result)
 {
-    uint32_t nodeId = GetNodeIdFromContext(context);
-
-    if (firstSshThr[nodeId])
+    std::vector<double> goodput;
+    for (uint64_t rx : result.rxBytes)
     {
-        *ssThreshStream[nodeId]->GetStream() << "0.0 " << oldval << std::endl;
-        firstSshThr[nodeId] = false;
+        goodput.push_back(rx * 8.0 / result.flowDuration);
     }
-    *ssThreshStream[nodeId]->GetStream()
-        << Simulator::Now().GetSeconds() << " " << newval << std::endl;
-    ssThreshValue[nodeId] = newval;
-
-    if (!firstCwnd[nodeId])
+    JsonObject record;
+    record.Field("program", PROGRAM_NAME)
+        .Field("prefix", prefix)
+        .Object("params", FormatParams(cfg))
+        .Field("seed", cfg.seed)
+        .Field("run", cfg.run)
+        .Field("flowDuration", result.flowDuration)
+        .Array("rxBytes", result.rxBytes)
+        .Array("goodput", goodput)
+        .Field("aggregateGoodput", result.aggregateGoodput)
+        .Field("simulatedSeconds", result.simulatedSeconds);
+    if (cfg.convergeTolerance > 0)
     {
-        *cWndStream[nodeId]->GetStream()
-            << Simulator::Now().GetSeconds() << " " << cWndValue[nodeId] << std::endl;
+        record.Field("precision", result.precision).Field("converged", result.converged);
+    }
+    if (cfg.flowStats)
+    {
+        record.Field("jain", result.jain)
+            .Field("meanBinJain", result.meanBinJain)
+            .Array("share", result.share);
+        if (result.rttImbalance > 0)
+        {
+            record.Field("rttImbalance", result.rttImbalance);
+        }
+    }
+    if (result.monitorBytesPerFlow > 0)
+    {
+        record.Field("monitorBytesPerFlow", result.monitorBytesPerFlow);
+    }
+    if (!result.phases.empty())
+    {
+        JsonObject phases;
+        for (const auto& [phase, seconds] : result.phases)
+        {
+            phases.Field(phase, seconds);
+        }
+        record.Object("phases", phases);
     }
+    record.Field("events", result.events).Field("wallSeconds", result.wallSeconds);
+    return record.Str() + "\n";
 }
 
 /**
- * RTT tracer.
+ * Format the record of a run that ended without a result (forkAt variant).
+ *
+ * The goodput is null, so a reader of the record sees a missing value and
+ * not a zero.
  *
- * @param context The context.
- * @param oldval Old value.
- * @param newval New value.
+ * @param cfg The configuration of the run.
+ * @param prefix Prefix of the output files of the run.
+ * @param error What went wrong.
+ * @return the JSON record, newline included.
  */
-static void
-RttTracer(std::string context, Time oldval, Time newval)
+static std::string
+FormatFailure(const SimConfig& cfg, const std::string& prefix, const std::string& error)
 {
-    uint32_t nodeId = GetNodeIdFromContext(context);
-
-    if (firstRtt[nodeId])
-    {
-        *rttStream[nodeId]->GetStream() << "0.0 " << oldval.GetSeconds() << std::endl;
-        firstRtt[nodeId] = false;
-    }
-    *rttStream[nodeId]->GetStream()
-        << Simulator::Now().GetSeconds() << " " << newval.GetSeconds() << std::endl;
+    JsonObject record;
+    record.Field("program", PROGRAM_NAME)
+        .Field("prefix", prefix)
+        .Object("params", FormatParams(cfg))
+        .Field("seed", cfg.seed)
+        .Field("run", cfg.run)
+        .Field("aggregateGoodput", std::numeric_limits<double>::quiet_NaN())
+        .Field("failed", true)
+        .Field("error", error);
+    return record.Str() + "\n";
 }
 
 /**
- * RTO tracer.
+ * Register the trace options of a configuration on a command line.
  *
- * @param context The context.
- * @param oldval Old value.
- * @param newval New value.
+ * @param cmd The command line.
+ * @param cfg The configuration that receives the parsed values.
  */
 static void
-RtoTracer(std::string context, Time oldval, Time newval)
+AddTraceValues(CommandLine& cmd, SimConfig& cfg)
 {
-    uint32_t nodeId = GetNodeIdFromContext(context);
-
-    if (firstRto[nodeId])
-    {
-        *rtoStream[nodeId]->GetStream() << "0.0 " << oldval.GetSeconds() << std::endl;
-        firstRto[nodeId] = false;
-    }
-    *rtoStream[nodeId]->GetStream()
-        << Simulator::Now().GetSeconds() << " " << newval.GetSeconds() << std::endl;
+    cmd.AddValue("traceFormat",
+                 "TCP trace sink: text (one .data file per metric) or binary (buffered records)",
+                 cfg.traceFormat);
+    cmd.AddValue("traceCompress", "Compress the binary trace with gzip", cfg.traceCompress);
+    cmd.AddValue("traceMode",
+                 "Trace reduction: full (every sample), change (only changes beyond "
+                 "traceThreshold) or bucket (min/max/last per traceBucket)",
+                 cfg.traceMode);
+    cmd.AddValue("traceThreshold",
+                 "Relative change that triggers a sample in change mode",
+                 cfg.traceThreshold);
+    cmd.AddValue("traceBucket", "Time bucket width in bucket mode", cfg.traceBucket);
+    cmd.AddValue("ipTrace",
+                 "IPv4 tracing: off, aggregate (tx/rx/drop counters per interface and flow, "
+                 "snapshot every ipTraceInterval), sampled (ASCII record of 1 in ipTraceSample "
+                 "events) or ascii (every event)",
+                 cfg.ipTrace);
+    cmd.AddValue("ipTraceInterval", "Snapshot interval in aggregate mode", cfg.ipTraceInterval);
+    cmd.AddValue("ipTraceSample", "Events per ASCII record in sampled mode", cfg.ipTraceSample);
 }
 
 /**
- * Next TX tracer.
+ * Register the scenario options of a configuration on a command line.
  *
- * @param context The context.
- * @param old Old sequence number.
- * @param nextTx Next sequence number.
+ * @param cmd The command line.
+ * @param cfg The configuration that receives the parsed values.
  */
 static void
-NextTxTracer(std::string context, SequenceNumber32 old [[maybe_unused]], SequenceNumber32 nextTx)
+AddConfigValues(CommandLine& cmd, SimConfig& cfg)
 {
-    uint32_t nodeId = GetNodeIdFromContext(context);
-
-    *nextTxStream[nodeId]->GetStream()
-        << Simulator::Now().GetSeconds() << " " << nextTx << std::endl;
+    cmd.AddValue("transport_prot",
+                 "Transport protocol to use: TcpNewReno, TcpLinuxReno, "
+                 "TcpHybla, TcpHighSpeed, TcpHtcp, TcpVegas, TcpScalable, TcpVeno, "
+                 "TcpBic, TcpYeah, TcpIllinois, TcpWestwoodPlus, TcpLedbat, "
+                 "TcpLp, TcpDctcp, TcpCubic, TcpBbr",
+                 cfg.transport_prot);
+    cmd.AddValue("errorRate", "Packet error rate", cfg.errorRate);
+    cmd.AddValue("delay", "Bottleneck delay", cfg.delay);
+    cmd.AddValue("dataRate", "Data Rate", cfg.dataRate);
+    cmd.AddValue("nFlows", "Number of flows", cfg.nFlows);
+    cmd.AddValue("seed", "Seed for simulation", cfg.seed);
+    cmd.AddValue("run", "RNG run number (independent substream of the seed)", cfg.run);
+    cmd.AddValue("streamBase",
+                 "First RNG stream assigned explicitly to the random variables of the topology",
+                 cfg.streamBase);
+    cmd.AddValue("duration",
+                 "Simulated time of the flows, in seconds; hard cap when convergeTolerance is set",
+                 cfg.duration);
+    cmd.AddValue("convergeTolerance",
+                 "Stop once the 95% CI of every flow's batch-mean goodput is within this "
+                 "fraction of the mean (0 = always simulate the full duration)",
+                 cfg.convergeTolerance);
+    cmd.AddValue("convergeWarmup",
+                 "Warm-up after the flows start that is left out of the goodput",
+                 cfg.convergeWarmup);
+    cmd.AddValue("convergeBatch", "Batch length of the convergence test", cfg.convergeBatch);
+    cmd.AddValue("convergeMinBatches",
+                 "Batches required before the convergence test is applied",
+                 cfg.convergeMinBatches);
+    cmd.AddValue("flowStats",
+                 "Collect per-flow goodput statistics (time series, Jain's index, shares)",
+                 cfg.flowStats);
+    cmd.AddValue("flowStatsBin", "Bin width of the per-flow goodput time series", cfg.flowStatsBin);
+    cmd.AddValue("flowStatsBins", "Bins kept per flow (ring buffer)", cfg.flowStatsBins);
+    cmd.AddValue("pcap", "Capture pcap on every link", cfg.pcap);
+    cmd.AddValue("pcapAsync",
+                 "Capture pcap from a background writer thread, keeping pcapSnaplen bytes "
+                 "of each packet",
+                 cfg.pcapAsync);
+    cmd.AddValue("pcapSnaplen", "Bytes kept of each packet (pcapAsync)", cfg.pcapSnaplen);
+    cmd.AddValue("pcapRotateBytes",
+                 "Pcap file size to rotate at, 0 = no limit (pcapAsync)",
+                 cfg.pcapRotateBytes);
+    cmd.AddValue("pcapRotateTime",
+                 "Simulated time per pcap file, 0 = no limit (pcapAsync)",
+                 cfg.pcapRotateTime);
+    cmd.AddValue("pcapMaxFiles",
+                 "Pcap files kept per device, 0 = all (pcapAsync)",
+                 cfg.pcapMaxFiles);
+    cmd.AddValue("monitor",
+                 "Flow monitoring: off, edge (per-flow counters at the source and sink, "
+                 "written to <prefix>-flows.csv) or full (FlowMonitor XML)",
+                 cfg.monitor);
+    cmd.AddValue("profile",
+                 "Time each phase of the run (setup, routing, Simulator::Run, output) and "
+                 "report events/s and simulated seconds per wall second",
+                 cfg.profile);
+    cmd.AddValue("scheduler",
+                 "Event scheduler: map, list, heap, calendar or priority",
+                 cfg.scheduler);
+    cmd.AddValue("outputPrefix", "Prefix (directory and base name) of the output files", cfg.prefix);
+    cmd.AddValue("forkAt",
+                 "Simulated time to fork one child per forkVariants entry at; each child "
+                 "changes its parameter and runs on with outputs in <prefix>-vN (0 = off)",
+                 cfg.forkAt);
+    cmd.AddValue("forkVariants",
+                 "Comma-separated errorRate=X or dataRate=Y changes, one child each (forkAt)",
+                 cfg.forkVariants);
+    cmd.AddValue("forkJobs", "Children running at a time, 0 = one per core (forkAt)", cfg.forkJobs);
+    AddTraceValues(cmd, cfg);
 }
 
 /**
- * In-flight tracer.
+ * Apply the trace options of a configuration to the tracer globals.
  *
- * @param context The context.
- * @param old Old value.
- * @param inFlight In flight value.
+ * @param cfg The configuration.
  */
 static void
-InFlightTracer(std::string context, uint32_t old [[maybe_unused]], uint32_t inFlight)
+ApplyTraceConfig(const SimConfig& cfg)
 {
-    uint32_t nodeId = GetNodeIdFromContext(context);
-
-    *inFlightStream[nodeId]->GetStream()
-        << Simulator::Now().GetSeconds() << " " << inFlight << std::endl;
+    if (cfg.traceFormat != "text" && cfg.traceFormat != "binary")
+    {
+        NS_FATAL_ERROR("traceFormat precisa ser text ou binary.");
+    }
+    if (cfg.traceMode == "full")
+    {
+        reductionMode = TRACE_FULL;
+    }
+    else if (cfg.traceMode == "change")
+    {
+        reductionMode = TRACE_CHANGE;
+    }
+    else if (cfg.traceMode == "bucket")
+    {
+        reductionMode = TRACE_BUCKET;
+    }
+    else
+    {
+        NS_FATAL_ERROR("traceMode precisa ser full, change ou bucket.");
+    }
+    if (!cfg.traceBucket.IsStrictlyPositive())
+    {
+        NS_FATAL_ERROR("traceBucket precisa ser positivo.");
+    }
+    traceThreshold = cfg.traceThreshold;
+    traceBucketNs = cfg.traceBucket.GetNanoSeconds();
+    if (cfg.ipTrace != "off" && cfg.ipTrace != "aggregate" && cfg.ipTrace != "sampled" &&
+        cfg.ipTrace != "ascii")
+    {
+        NS_FATAL_ERROR("ipTrace precisa ser off, aggregate, sampled ou ascii.");
+    }
+    if (!cfg.ipTraceInterval.IsStrictlyPositive() || cfg.ipTraceSample == 0)
+    {
+        NS_FATAL_ERROR("ipTraceInterval e ipTraceSample precisam ser positivos.");
+    }
 }
 
 /**
- * Next RX tracer.
- *
- * @param context The context.
- * @param old Old sequence number.
- * @param nextRx Next sequence number.
+ * CSV header of the batch output.
  */
-static void
-NextRxTracer(std::string context, SequenceNumber32 old [[maybe_unused]], SequenceNumber32 nextRx)
-{
-    uint32_t nodeId = GetNodeIdFromContext(context);
-
-    *nextRxStream[nodeId]->GetStream()
-        << Simulator::Now().GetSeconds() << " " << nextRx << std::endl;
-}
+static const char* const BATCH_HEADER =
+    "record,line,seed,runs,transport_prot,nFlows,delay,dataRate,errorRate,"
+    "goodput,goodput_sd,goodput_ci95,events,wall_s";
 
 /**
- * Congestion window trace connection.
- *
- * @param cwnd_tr_file_name Congestion window trace file name.
- * @param nodeId Node ID.
+ * Goodput samples of the replications of one batch line.
  */
-static void
-TraceCwnd(std::string cwnd_tr_file_name, uint32_t nodeId)
+struct BatchSamples
 {
-    AsciiTraceHelper ascii;
-    cWndStream[nodeId] = ascii.CreateFileStream(cwnd_tr_file_name);
-    Config::Connect("/NodeList/" + std::to_string(nodeId) +
-                        "/$ns3::TcpL4Protocol/SocketList/0/CongestionWindow",
-                    MakeCallback(&CwndTracer));
-}
+    std::vector<double> goodput; //!< Aggregate goodput of each run.
+    uint64_t events{0};           //!< Events executed, summed over the runs.
+    double wallSeconds{0};        //!< Wall-clock time, summed over the runs.
+
+    /**
+     * Add the result of one run.
+     *
+     * @param result The result.
+     */
+    void Add(const RunResult& result)
+    {
+        goodput.push_back(result.aggregateGoodput);
+        events += result.events;
+        wallSeconds += result.wallSeconds;
+    }
+};
 
 /**
- * Slow start threshold trace connection.
+ * Write the configuration columns of a batch record.
  *
- * @param ssthresh_tr_file_name Slow start threshold trace file name.
- * @param nodeId Node ID.
+ * @param out CSV output.
+ * @param cfg The configuration.
  */
 static void
-TraceSsThresh(std::string ssthresh_tr_file_name, uint32_t nodeId)
+WriteBatchConfig(std::ostream& out, const SimConfig& cfg)
 {
-    AsciiTraceHelper ascii;
-    ssThreshStream[nodeId] = ascii.CreateFileStream(ssthresh_tr_file_name);
-    Config::Connect("/NodeList/" + std::to_string(nodeId) +
-                        "/$ns3::TcpL4Protocol/SocketList/0/SlowStartThreshold",
-                    MakeCallback(&SsThreshTracer));
+    out << cfg.transport_prot << "," << cfg.nFlows << "," << cfg.delay << "," << cfg.dataRate
+        << "," << cfg.errorRate;
 }
 
 /**
- * RTT trace connection.
+ * Write the record of one batch run.
  *
- * @param rtt_tr_file_name RTT trace file name.
- * @param nodeId Node ID.
+ * @param out CSV output.
+ * @param line Line of the parameter file.
+ * @param cfg The configuration of the run.
+ * @param result The result of the run.
  */
 static void
-TraceRtt(std::string rtt_tr_file_name, uint32_t nodeId)
+WriteBatchRun(std::ostream& out, uint32_t line, const SimConfig& cfg, const RunResult& result)
 {
-    AsciiTraceHelper ascii;
-    rttStream[nodeId] = ascii.CreateFileStream(rtt_tr_file_name);
-    Config::Connect("/NodeList/" + std::to_string(nodeId) + "/$ns3::TcpL4Protocol/SocketList/0/RTT",
-                    MakeCallback(&RttTracer));
+    out << "run," << line << "," << cfg.seed << ",1,";
+    WriteBatchConfig(out, cfg);
+    out << "," << result.aggregateGoodput << ",,," << result.events << "," << result.wallSeconds
+        << std::endl;
 }
 
 /**
- * RTO trace connection.
+ * Write the aggregate record of one batch line.
  *
- * @param rto_tr_file_name RTO trace file name.
- * @param nodeId Node ID.
+ * @param out CSV output.
+ * @param line Line of the parameter file.
+ * @param cfg The configuration of the line.
+ * @param samples The samples of its replications.
  */
 static void
-TraceRto(std::string rto_tr_file_name, uint32_t nodeId)
+WriteBatchSummary(std::ostream& out,
+                  uint32_t line,
+                  const SimConfig& cfg,
+                  const BatchSamples& samples)
 {
-    AsciiTraceHelper ascii;
-    rtoStream[nodeId] = ascii.CreateFileStream(rto_tr_file_name);
-    Config::Connect("/NodeList/" + std::to_string(nodeId) + "/$ns3::TcpL4Protocol/SocketList/0/RTO",
-                    MakeCallback(&RtoTracer));
+    Summary goodput = Summarize(samples.goodput);
+    out << "agg," << line << ",," << goodput.n << ",";
+    WriteBatchConfig(out, cfg);
+    out << "," << goodput.mean << "," << goodput.stddev << "," << goodput.ci95 << ","
+        << samples.events << "," << samples.wallSeconds << std::endl;
 }
 
 /**
- * Next TX trace connection.
- *
- * @param next_tx_seq_file_name Next TX trace file name.
- * @param nodeId Node ID.
+ * IPv4 packet counters of an interface or a flow.
  */
-static void
-TraceNextTx(std::string& next_tx_seq_file_name, uint32_t nodeId)
+struct IpCounters
 {
-    AsciiTraceHelper ascii;
-    nextTxStream[nodeId] = ascii.CreateFileStream(next_tx_seq_file_name);
-    Config::Connect("/NodeList/" + std::to_string(nodeId) +
-                        "/$ns3::TcpL4Protocol/SocketList/0/NextTxSequence",
-                    MakeCallback(&NextTxTracer));
-}
+    uint64_t txPackets{0}; //!< Packets sent down to the device.
+    uint64_t txBytes{0};   //!< Bytes sent down to the device.
+    uint64_t rxPackets{0}; //!< Packets received from the device.
+    uint64_t rxBytes{0};   //!< Bytes received from the device.
+    uint64_t drops{0};     //!< Packets dropped by IPv4.
+};
 
 /**
- * In flight trace connection.
+ * IPv4-level tracing (ipTrace option), in place of an ASCII record of every
+ * IP event on every node.
  *
- * @param in_flight_file_name In flight trace file name.
- * @param nodeId Node ID.
+ * aggregate keeps tx/rx/drop counters per interface and per flow (summed over
+ * the nodes on the path) and writes a snapshot of the interface counters every
+ * interval; sampled writes the ASCII record of one in every N events.
  */
-static void
-TraceInFlight(std::string& in_flight_file_name, uint32_t nodeId)
+class IpTracer
+{
+  public:
+    /**
+     * Hook the IPv4 layer of every node.
+     *
+     * @param nodes The nodes.
+     * @param sampled Sampled mode instead of aggregate.
+     * @param prefix Prefix of the output files.
+     * @param interval Snapshot interval (aggregate).
+     * @param sample Events per sampled record (sampled).
+     * @param portBase Server port of flow 0.
+     * @param flows Number of flows.
+     */
+    void Start(const NodeContainer& nodes,
+               bool sampled,
+               const std::string& prefix,
+               Time interval,
+               uint32_t sample,
+               uint16_t portBase,
+               uint32_t flows);
+
+    /**
+     * @return true if Start was called.
+     */
+    bool IsEnabled() const
+    {
+        return m_enabled;
+    }
+
+    /**
+     * Write the last snapshot and the per-flow counters.
+     */
+    void Finish();
+
+    /**
+     * Write out what is buffered in the output file.
+     */
+    void Flush()
+    {
+        if (m_out)
+        {
+            m_out->GetStream()->flush();
+        }
+    }
+
+    /**
+     * Move the output files to another prefix (child of forkAt).
+     *
+     * @param prefix The new prefix.
+     */
+    void Reopen(const std::string& prefix)
+    {
+        m_prefix = prefix;
+        AsciiTraceHelper ascii;
+        m_out = ascii.CreateFileStream(prefix + (m_sampled ? "-ip-sampled" : "-ip.data"));
+    }
+
+  private:
+    /**
+     * Tx trace of an IPv4 layer.
+     *
+     * @param packet The packet, IPv4 header included.
+     * @param ipv4 The IPv4 layer.
+     * @param interface Output interface.
+     */
+    void Tx(Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface);
+
+    /**
+     * Rx trace of an IPv4 layer.
+     *
+     * @param packet The packet, IPv4 header included.
+     * @param ipv4 The IPv4 layer.
+     * @param interface Input interface.
+     */
+    void Rx(Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface);
+
+    /**
+     * Drop trace of an IPv4 layer.
+     *
+     * @param header IPv4 header of the packet.
+     * @param packet The packet, without the IPv4 header.
+     * @param reason Why it was dropped.
+     * @param ipv4 The IPv4 layer.
+     * @param interface Interface.
+     */
+    void Drop(const Ipv4Header& header,
+              Ptr<const Packet> packet,
+              Ipv4L3Protocol::DropReason reason,
+              Ptr<Ipv4> ipv4,
+              uint32_t interface);
+
+    /**
+     * Flow of a packet, from its TCP ports.
+     *
+     * @param packet The packet.
+     * @param withIpHeader Whether the packet starts with the IPv4 header.
+     * @return the flow, or -1 if the packet belongs to none.
+     */
+    int32_t FlowOf(Ptr<const Packet> packet, bool withIpHeader) const;
+
+    /**
+     * Counters of an interface, created on first use.
+     *
+     * @param ipv4 The IPv4 layer.
+     * @param interface The interface.
+     * @return the counters.
+     */
+    IpCounters& Interface(Ptr<Ipv4> ipv4, uint32_t interface);
+
+    /**
+     * Write the ASCII record of one in every m_sample events.
+     *
+     * @param event Event letter (t, r or d).
+     * @param ipv4 The IPv4 layer.
+     * @param source Trace source name.
+     * @param interface The interface.
+     * @param packet The packet.
+     */
+    void Sample(char event,
+                Ptr<Ipv4> ipv4,
+                const char* source,
+                uint32_t interface,
+                Ptr<const Packet> packet);
+
+    /**
+     * Write the cumulative counters of every interface.
+     */
+    void Snapshot();
+
+    /**
+     * Periodic snapshot: write it and schedule the next one.
+     */
+    void Tick();
+
+    std::vector<std::vector<IpCounters>> m_interfaces; //!< Counters by node and interface.
+    std::vector<IpCounters> m_flows;                   //!< Counters of each flow.
+    uint16_t m_portBase{0};                            //!< Server port of flow 0.
+    bool m_sampled{false};                             //!< Sampled mode.
+    uint32_t m_sample{1};                              //!< Events per sampled record.
+    uint64_t m_events{0};                              //!< Events seen (sampled).
+    Time m_interval;                                   //!< Snapshot interval.
+    std::string m_prefix;                              //!< Prefix of the output files.
+    Ptr<OutputStreamWrapper> m_out;                    //!< Snapshots or sampled records.
+    EventId m_snapshot;                                //!< Next snapshot.
+    bool m_enabled{false};                             //!< Start was called.
+};
+
+static IpTracer ipTracer; //!< IPv4-level tracing (ipTrace option).
+
+void
+IpTracer::Start(const NodeContainer& nodes,
+                bool sampled,
+                const std::string& prefix,
+                Time interval,
+                uint32_t sample,
+                uint16_t portBase,
+                uint32_t flows)
 {
+    m_interfaces.clear();
+    m_flows.assign(flows, IpCounters());
+    m_portBase = portBase;
+    m_sampled = sampled;
+    m_sample = sample;
+    m_events = 0;
+    m_interval = interval;
+    m_prefix = prefix;
+    m_enabled = true;
     AsciiTraceHelper ascii;
-    inFlightStream[nodeId] = ascii.CreateFileStream(in_flight_file_name);
-    Config::Connect("/NodeList/" + std::to_string(nodeId) +
-                        "/$ns3::TcpL4Protocol/SocketList/0/BytesInFlight",
-                    MakeCallback(&InFlightTracer));
+    m_out = ascii.CreateFileStream(prefix + (sampled ? "-ip-sampled" : "-ip.data"));
+    for (auto it = nodes.Begin(); it != nodes.End(); ++it)
+    {
+        Ptr<Ipv4L3Protocol> ipv4 = (*it)->GetObject<Ipv4L3Protocol>();
+        ipv4->TraceConnectWithoutContext("Tx", MakeCallback(&IpTracer::Tx, this));
+        ipv4->TraceConnectWithoutContext("Rx", MakeCallback(&IpTracer::Rx, this));
+        ipv4->TraceConnectWithoutContext("Drop", MakeCallback(&IpTracer::Drop, this));
+    }
+    if (!sampled)
+    {
+        m_snapshot = Simulator::Schedule(interval, &IpTracer::Tick, this);
+    }
+}
+
+int32_t
+IpTracer::FlowOf(Ptr<const Packet> packet, bool withIpHeader) const
+{
+    // So os primeiros bytes: cabecalho IPv4 (se houver) e as portas TCP
+    uint8_t bytes[64];
+    uint32_t size = packet->CopyData(bytes, sizeof(bytes));
+    uint32_t offset = 0;
+    if (withIpHeader)
+    {
+        if (size < 20 || bytes[9] != TcpL4Protocol::PROT_NUMBER)
+        {
+            return -1;
+        }
+        offset = (bytes[0] & 0x0f) * 4;
+    }
+    if (size < offset + 4)
+    {
+        return -1;
+    }
+    uint16_t source = (bytes[offset] << 8) | bytes[offset + 1];
+    uint16_t destination = (bytes[offset + 2] << 8) | bytes[offset + 3];
+    // Dados vao para a porta do fluxo; ACKs saem dela
+    for (uint16_t port : {destination, source})
+    {
+        uint32_t flow = static_cast<uint16_t>(port - m_portBase);
+        if (flow < m_flows.size())
+        {
+            return flow;
+        }
+    }
+    return -1;
+}
+
+IpCounters&
+IpTracer::Interface(Ptr<Ipv4> ipv4, uint32_t interface)
+{
+    uint32_t node = ipv4->GetObject<Node>()->GetId();
+    if (node >= m_interfaces.size())
+    {
+        m_interfaces.resize(node + 1);
+    }
+    if (interface >= m_interfaces[node].size())
+    {
+        m_interfaces[node].resize(interface + 1);
+    }
+    return m_interfaces[node][interface];
+}
+
+void
+IpTracer::Tx(Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+{
+    if (m_sampled)
+    {
+        Sample('t', ipv4, "Tx", interface, packet);
+        return;
+    }
+    IpCounters& counters = Interface(ipv4, interface);
+    counters.txPackets++;
+    counters.txBytes += packet->GetSize();
+    int32_t flow = FlowOf(packet, true);
+    if (flow >= 0)
+    {
+        m_flows[flow].txPackets++;
+        m_flows[flow].txBytes += packet->GetSize();
+    }
+}
+
+void
+IpTracer::Rx(Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+{
+    if (m_sampled)
+    {
+        Sample('r', ipv4, "Rx", interface, packet);
+        return;
+    }
+    IpCounters& counters = Interface(ipv4, interface);
+    counters.rxPackets++;
+    counters.rxBytes += packet->GetSize();
+    int32_t flow = FlowOf(packet, true);
+    if (flow >= 0)
+    {
+        m_flows[flow].rxPackets++;
+        m_flows[flow].rxBytes += packet->GetSize();
+    }
+}
+
+void
+IpTracer::Drop(const Ipv4Header& header,
+               Ptr<const Packet> packet,
+               Ipv4L3Protocol::DropReason reason [[maybe_unused]],
+               Ptr<Ipv4> ipv4,
+               uint32_t interface)
+{
+    if (m_sampled)
+    {
+        Ptr<Packet> copy = packet->Copy();
+        copy->AddHeader(header);
+        Sample('d', ipv4, "Drop", interface, copy);
+        return;
+    }
+    Interface(ipv4, interface).drops++;
+    int32_t flow = header.GetProtocol() == TcpL4Protocol::PROT_NUMBER ? FlowOf(packet, false) : -1;
+    if (flow >= 0)
+    {
+        m_flows[flow].drops++;
+    }
+}
+
+void
+IpTracer::Sample(char event,
+                 Ptr<Ipv4> ipv4,
+                 const char* source,
+                 uint32_t interface,
+                 Ptr<const Packet> packet)
+{
+    if (m_events++ % m_sample != 0)
+    {
+        return;
+    }
+    // Mesmo formato do EnableAsciiIpv4All
+    *m_out->GetStream() << event << " " << Simulator::Now().GetSeconds() << " /NodeList/"
+                        << ipv4->GetObject<Node>()->GetId() << "/$ns3::Ipv4L3Protocol/"
+                        << source << "(" << interface << ") " << *packet << "\n";
+}
+
+void
+IpTracer::Snapshot()
+{
+    std::ostream& os = *m_out->GetStream();
+    double now = Simulator::Now().GetSeconds();
+    for (uint32_t node = 0; node < m_interfaces.size(); ++node)
+    {
+        for (uint32_t interface = 0; interface < m_interfaces[node].size(); ++interface)
+        {
+            const IpCounters& c = m_interfaces[node][interface];
+            os << now << " " << node << " " << interface << " " << c.txPackets << " "
+               << c.txBytes << " " << c.rxPackets << " " << c.rxBytes << " " << c.drops << "\n";
+        }
+    }
+}
+
+void
+IpTracer::Tick()
+{
+    Snapshot();
+    m_snapshot = Simulator::Schedule(m_interval, &IpTracer::Tick, this);
+}
+
+void
+IpTracer::Finish()
+{
+    if (!m_sampled)
+    {
+        m_snapshot.Cancel();
+        Snapshot();
+        std::ofstream out(m_prefix + "-ip-flows.data");
+        for (size_t flow = 0; flow < m_flows.size(); ++flow)
+        {
+            const IpCounters& c = m_flows[flow];
+            out << flow << " " << c.txPackets << " " << c.txBytes << " " << c.rxPackets << " "
+                << c.rxBytes << " " << c.drops << "\n";
+        }
+    }
+    m_out = nullptr;
 }
 
 /**
- * Next RX trace connection.
+ * Warm-start variants of one run (forkAt option).
+ *
+ * The run is simulated once up to forkAt, where the process forks one child
+ * per entry of forkVariants. Each child changes its parameter (bottleneck
+ * errorRate or dataRate), moves its output files to <prefix>-vN and runs on
+ * to the stop time, so the handshakes and slow start before forkAt are
+ * simulated only once for all variants. The parent goes on as the unchanged
+ * run and, at its end, collects the JSON record of every child through a
+ * pipe and writes them after its own, in variant order; a child that fails
+ * gets a failure record instead.
  *
- * @param next_rx_seq_file_name Next RX trace file name.
- * @param nodeId Node ID.
+ * Every child is forked at forkAt, but a child only runs on once it takes a
+ * token from a pipe that holds forkJobs of them, and gives it back when it
+ * is done, so the parent never waits inside the fork event.
+ *
+ * The trace files of a child only hold what follows forkAt; what came before
+ * is in the files of the parent.
  */
-static void
-TraceNextRx(std::string& next_rx_seq_file_name, uint32_t nodeId)
+class ForkSweep
 {
-    AsciiTraceHelper ascii;
-    nextRxStream[nodeId] = ascii.CreateFileStream(next_rx_seq_file_name);
-    Config::Connect("/NodeList/" + std::to_string(nodeId) +
-                        "/$ns3::TcpL4Protocol/SocketList/0/RxBuffer/NextRxSequence",
-                    MakeCallback(&NextRxTracer));
+  public:
+    /**
+     * Parse and check the variants of a run; does nothing unless forkAt is set.
+     *
+     * @param cfg The configuration of the run.
+     */
+    void Configure(const SimConfig& cfg);
+
+    /**
+     * @return true if this run forks.
+     */
+    bool IsEnabled() const
+    {
+        return m_enabled;
+    }
+
+    /**
+     * Schedule the fork.
+     *
+     * @param prefix Prefix of the output files of the run.
+     * @param errorModel Receive error model of the bottleneck.
+     * @param bottleneck Devices of the bottleneck link.
+     */
+    void Start(const std::string& prefix,
+               Ptr<RateErrorModel> errorModel,
+               const NetDeviceContainer& bottleneck);
+
+    /**
+     * @return true in a child process.
+     */
+    bool IsChild() const
+    {
+        return m_child;
+    }
+
+    /**
+     * @return the configuration of this child.
+     */
+    const SimConfig& Config() const
+    {
+        return m_cfg;
+    }
+
+    /**
+     * @return the output file prefix of this child.
+     */
+    const std::string& Prefix() const
+    {
+        return m_prefix;
+    }
+
+    /**
+     * Give the token back, write the record of this child and exit (child
+     * only).
+     *
+     * @param record The result record.
+     */
+    [[noreturn]] void Exit(const std::string& record);
+
+    /**
+     * Wait for every child, pass its record on to resultWriter and print one
+     * line per variant (parent only).
+     *
+     * @param os Output stream.
+     */
+    void Finish(std::ostream& os);
+
+  private:
+    /**
+     * One parameter change.
+     */
+    struct Variant
+    {
+        std::string name;  //!< errorRate or dataRate.
+        std::string value; //!< New value.
+    };
+
+    /**
+     * A running child.
+     */
+    struct Child
+    {
+        pid_t pid;        //!< Process ID.
+        int fd;           //!< Read end of its result pipe.
+        uint32_t variant; //!< Its variant.
+    };
+
+    /**
+     * Outcome of a variant.
+     */
+    struct Outcome
+    {
+        uint32_t variant;  //!< The variant.
+        bool ok;           //!< The child exited normally with a record.
+        double goodput;    //!< Aggregate goodput of its record, in bps.
+        std::string error; //!< Why the child failed.
+    };
+
+    /**
+     * Fork the children; runs at forkAt.
+     */
+    void Fork();
+
+    /**
+     * @param variant The variant.
+     * @return the configuration of the run with the change of a variant.
+     */
+    SimConfig VariantConfig(uint32_t variant) const;
+
+    /**
+     * Turn this process into the child of a variant.
+     *
+     * @param variant The variant.
+     * @param fd Write end of the result pipe.
+     */
+    void Become(uint32_t variant, int fd);
+
+    /**
+     * Read the records of every child until their pipes close, reaping each
+     * child as its pipe closes.
+     *
+     * @return the record of each child, in the order of m_children.
+     */
+    std::vector<std::string> Collect();
+
+    SimConfig m_cfg;                  //!< Run configuration (the variant one in a child).
+    std::vector<Variant> m_variants;  //!< Variants to fork.
+    uint32_t m_jobs{1};               //!< Children running at a time.
+    std::string m_prefix;             //!< Output prefix (the variant one in a child).
+    Ptr<RateErrorModel> m_errorModel; //!< Bottleneck error model.
+    NetDeviceContainer m_bottleneck;  //!< Bottleneck devices.
+    std::vector<Child> m_children;    //!< Children, by variant.
+    std::vector<int> m_status;        //!< Wait status of each child.
+    int m_tokens[2]{-1, -1};          //!< Token pipe limiting the running children.
+    std::vector<Outcome> m_outcomes;  //!< Collected variants.
+    double m_warmupWall{0};           //!< Wall time up to the fork, in seconds.
+    bool m_enabled{false};            //!< Configure found variants.
+    bool m_child{false};              //!< This is a child process.
+    bool m_forked{false};             //!< Fork ran in this run.
+
+    std::chrono::steady_clock::time_point m_runStart; //!< Wall time the run started.
+};
+
+static ForkSweep forkSweep; //!< Warm-start variants (forkAt option).
+
+void
+ForkSweep::Configure(const SimConfig& cfg)
+{
+    m_enabled = false;
+    m_forked = false;
+    m_variants.clear();
+    m_outcomes.clear();
+    if (cfg.forkAt.IsZero())
+    {
+        return;
+    }
+    if (!cfg.forkAt.IsStrictlyPositive() || cfg.forkAt >= Seconds(1 + cfg.duration))
+    {
+        NS_FATAL_ERROR("forkAt precisa estar entre 0 e o fim da simulacao.");
+    }
+    if (cfg.pcap || cfg.traceCompress || cfg.ipTrace == "ascii")
+    {
+        NS_FATAL_ERROR("forkAt nao funciona com pcap, traceCompress ou ipTrace=ascii.");
+    }
+    std::istringstream list(cfg.forkVariants);
+    std::string item;
+    while (std::getline(list, item, ','))
+    {
+        size_t equals = item.find('=');
+        Variant variant;
+        if (equals != std::string::npos)
+        {
+            variant = {item.substr(0, equals), item.substr(equals + 1)};
+        }
+        if (variant.name == "dataRate")
+        {
+            DataRate(variant.value);
+        }
+        else if (variant.name != "errorRate")
+        {
+            NS_FATAL_ERROR("forkVariants precisa ser uma lista de errorRate=X ou dataRate=Y "
+                           "separados por virgula.");
+        }
+        else
+        {
+            try
+            {
+                std::stod(variant.value);
+            }
+            catch (const std::exception&)
+            {
+                NS_FATAL_ERROR("errorRate invalido em forkVariants: " << variant.value);
+            }
+        }
+        m_variants.push_back(variant);
+    }
+    if (m_variants.empty())
+    {
+        NS_FATAL_ERROR("forkAt precisa de pelo menos uma variante em forkVariants.");
+    }
+    m_cfg = cfg;
+    m_jobs = cfg.forkJobs ? cfg.forkJobs : std::max(1u, std::thread::hardware_concurrency());
+    m_enabled = true;
 }
 
-int
-main(int argc, char* argv[])
+void
+ForkSweep::Start(const std::string& prefix,
+                 Ptr<RateErrorModel> errorModel,
+                 const NetDeviceContainer& bottleneck)
 {
-    std::string dataRate = "10Mbps";
-    std::string delay = "20ms";
-    double errorRate = 0.00001;
-    uint32_t nFlows = 1;
-    std::string transport_prot = "TcpCubic";
-    uint32_t seed = 1;
+    m_prefix = prefix;
+    m_errorModel = errorModel;
+    m_bottleneck = bottleneck;
+    m_runStart = std::chrono::steady_clock::now();
+    Simulator::Schedule(m_cfg.forkAt, &ForkSweep::Fork, this);
+}
 
-    CommandLine cmd(__FILE__);
-    cmd.AddValue("transport_prot",
-                 "Transport protocol to use: TcpNewReno, TcpLinuxReno, "
-                 "TcpHybla, TcpHighSpeed, TcpHtcp, TcpVegas, TcpScalable, TcpVeno, "
-                 "TcpBic, TcpYeah, TcpIllinois, TcpWestwoodPlus, TcpLedbat, "
-                 "TcpLp, TcpDctcp, TcpCubic, TcpBbr",
-                 transport_prot);
-    cmd.AddValue("errorRate", "Packet error rate", errorRate);
-    cmd.AddValue("delay", "Bottleneck delay", delay);
-    cmd.AddValue("dataRate", "Data Rate", dataRate);
-    cmd.AddValue("nFlows", "Number of flows", nFlows);
-    cmd.AddValue("seed", "Seed for simulation", seed);
-    cmd.Parse(argc, argv);
+void
+ForkSweep::Fork()
+{
+    m_forked = true;
+    m_warmupWall =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - m_runStart).count();
+    // Nada pode ficar em buffer: o filho herdaria e gravaria de novo
+    binaryTrace.Flush();
+    if (tcpTrace)
+    {
+        tcpTrace->GetStream()->flush();
+    }
+    ipTracer.Flush();
+    std::cout.flush();
+    std::fflush(nullptr);
+
+    if (pipe(m_tokens) != 0)
+    {
+        NS_FATAL_ERROR("Nao foi possivel criar o pipe das fichas: " << std::strerror(errno));
+    }
+    std::string tokens(std::min<size_t>(m_jobs, m_variants.size()), '+');
+    if (write(m_tokens[1], tokens.data(), tokens.size()) != static_cast<ssize_t>(tokens.size()))
+    {
+        NS_FATAL_ERROR("Nao foi possivel preencher o pipe das fichas: " << std::strerror(errno));
+    }
+    for (uint32_t i = 0; i < m_variants.size(); ++i)
+    {
+        int fds[2];
+        if (pipe(fds) != 0)
+        {
+            NS_FATAL_ERROR("Nao foi possivel criar o pipe da variante: " << std::strerror(errno));
+        }
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            NS_FATAL_ERROR("fork falhou: " << std::strerror(errno));
+        }
+        if (pid == 0)
+        {
+            close(fds[0]);
+            Become(i, fds[1]);
+            return;
+        }
+        close(fds[1]);
+        m_children.push_back({pid, fds[0], i});
+    }
+}
+
+SimConfig
+ForkSweep::VariantConfig(uint32_t variant) const
+{
+    const Variant& v = m_variants[variant];
+    SimConfig cfg = m_cfg;
+    if (v.name == "errorRate")
+    {
+        cfg.errorRate = std::stod(v.value);
+    }
+    else
+    {
+        cfg.dataRate = v.value;
+    }
+    return cfg;
+}
+
+void
+ForkSweep::Become(uint32_t variant, int fd)
+{
+    m_child = true;
+    // Sem o pai ninguem le o registro; o filho nao fica esperando uma ficha
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    for (const Child& sibling : m_children)
+    {
+        close(sibling.fd);
+    }
+    m_children.clear();
+    char token;
+    while (read(m_tokens[0], &token, 1) < 0 && errno == EINTR)
+    {
+    }
+
+    const Variant& v = m_variants[variant];
+    m_cfg = VariantConfig(variant);
+    m_prefix += "-v" + std::to_string(variant + 1);
+    if (!std::freopen((m_prefix + ".out").c_str(), "w", stdout))
+    {
+        NS_FATAL_ERROR("Nao foi possivel abrir " << m_prefix << ".out");
+    }
+    std::cout << "Variante " << variant + 1 << ": " << v.name << "=" << v.value << " a partir de "
+              << m_cfg.forkAt.GetSeconds() << " s" << std::endl;
+    if (v.name == "errorRate")
+    {
+        m_errorModel->SetRate(m_cfg.errorRate);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < m_bottleneck.GetN(); ++i)
+        {
+            DynamicCast<PointToPointNetDevice>(m_bottleneck.Get(i))->SetDataRate(DataRate(v.value));
+        }
+        if (flowStats.IsEnabled())
+        {
+            flowStats.SetBottleneck(DataRate(v.value).GetBitRate());
+        }
+    }
+
+    // Traces do filho em arquivos proprios
+    if (tcpTrace)
+    {
+        AsciiTraceHelper tcpAscii;
+        tcpTrace = tcpAscii.CreateFileStream(m_prefix + "-tcp.data");
+    }
+    if (binaryTrace.IsOpen())
+    {
+        binaryTrace.Open(m_prefix + "-tcp.bin", false, 65536);
+    }
+    if (ipTracer.IsEnabled())
+    {
+        ipTracer.Reopen(m_prefix);
+    }
+    resultWriter.Open("fd:" + std::to_string(fd));
+}
+
+void
+ForkSweep::Exit(const std::string& record)
+{
+    // A ficha volta antes do registro: o pai so le os pipes no fim da propria
+    // execucao, e um registro maior que o pipe prenderia a ficha ate la
+    char token = '+';
+    while (write(m_tokens[1], &token, 1) < 0 && errno == EINTR)
+    {
+    }
+    resultWriter.WriteRecord(record);
+    std::fflush(nullptr);
+    _exit(0);
+}
+
+std::vector<std::string>
+ForkSweep::Collect()
+{
+    std::vector<std::string> records(m_children.size());
+    std::vector<pollfd> fds;
+    for (const Child& child : m_children)
+    {
+        fds.push_back({child.fd, POLLIN, 0});
+    }
+    m_status.assign(m_children.size(), 0);
+    size_t open = fds.size();
+    while (open > 0)
+    {
+        if (poll(fds.data(), fds.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            NS_FATAL_ERROR("poll falhou: " << std::strerror(errno));
+        }
+        for (size_t i = 0; i < fds.size(); ++i)
+        {
+            if (fds[i].fd < 0 || !fds[i].revents)
+            {
+                continue;
+            }
+            char buffer[4096];
+            ssize_t n = read(fds[i].fd, buffer, sizeof(buffer));
+            if (n > 0)
+            {
+                records[i].append(buffer, n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            close(fds[i].fd);
+            fds[i].fd = -1;
+            open--;
+            while (waitpid(m_children[i].pid, &m_status[i], 0) < 0 && errno == EINTR)
+            {
+            }
+            if (!WIFEXITED(m_status[i]) || WEXITSTATUS(m_status[i]) != 0)
+            {
+                // Um filho que falhou nao devolveu a ficha
+                char token = '+';
+                while (write(m_tokens[1], &token, 1) < 0 && errno == EINTR)
+                {
+                }
+            }
+        }
+    }
+    return records;
+}
+
+void
+ForkSweep::Finish(std::ostream& os)
+{
+    std::vector<std::string> records = Collect();
+    for (size_t i = 0; i < m_children.size(); ++i)
+    {
+        uint32_t variant = m_children[i].variant;
+        std::string prefix = m_prefix + "-v" + std::to_string(variant + 1);
+        int status = m_status[i];
+        Outcome outcome{variant, false, 0, ""};
+        if (WIFSIGNALED(status))
+        {
+            outcome.error = "sinal " + std::to_string(WTERMSIG(status));
+        }
+        else if (WEXITSTATUS(status) != 0)
+        {
+            outcome.error = "saida " + std::to_string(WEXITSTATUS(status));
+        }
+        else if (records[i].empty())
+        {
+            outcome.error = "sem registro";
+        }
+        else
+        {
+            outcome.ok = true;
+            outcome.goodput = JsonNumberField(records[i], "aggregateGoodput");
+        }
+        if (resultWriter.IsOpen())
+        {
+            resultWriter.WriteRecord(outcome.ok ? records[i]
+                                                : FormatFailure(VariantConfig(variant),
+                                                                prefix,
+                                                                outcome.error));
+        }
+        m_outcomes.push_back(outcome);
+    }
+    m_children.clear();
+    if (m_tokens[0] >= 0)
+    {
+        close(m_tokens[0]);
+        close(m_tokens[1]);
+        m_tokens[0] = m_tokens[1] = -1;
+    }
+    m_enabled = false;
+    if (!m_forked)
+    {
+        // A convergencia parou a simulacao antes de forkAt
+        os << "Fork em " << m_cfg.forkAt.GetSeconds() << " s: nao ocorreu" << std::endl;
+        return;
+    }
+    os << "Fork em " << m_cfg.forkAt.GetSeconds() << " s: " << m_variants.size()
+       << " variantes | aquecimento de " << m_warmupWall
+       << " s de parede simulado uma vez" << std::endl;
+    for (const Outcome& outcome : m_outcomes)
+    {
+        const Variant& v = m_variants[outcome.variant];
+        os << "Variante " << outcome.variant + 1 << " (" << v.name << "=" << v.value << "): ";
+        if (outcome.ok)
+        {
+            os << "Goodput Agregado " << outcome.goodput << " bps";
+        }
+        else
+        {
+            os << "falhou (" << outcome.error << ")";
+        }
+        os << " | saida " << m_prefix << "-v" << outcome.variant + 1 << ".out" << std::endl;
+    }
+}
+
+/**
+ * Build the topology, run one simulation and tear it down again.
+ *
+ * @param cfg Parameters of the run.
+ * @param prefix_file_name Prefix of the output files.
+ * @return the results of the run.
+ */
+static RunResult
+RunSimulation(const SimConfig& cfg, const std::string& prefix_file_name)
+{
+    const std::string& dataRate = cfg.dataRate;
+    double errorRate = cfg.errorRate;
+    uint32_t nFlows = cfg.nFlows;
+    const std::string& transport_prot = cfg.transport_prot;
+    uint32_t seed = cfg.seed;
+    const std::string& traceFormat = cfg.traceFormat;
+    bool traceCompress = cfg.traceCompress;
+    ApplyTraceConfig(cfg);
+    forkSweep.Configure(cfg);
+    profiler.Start(cfg.profile);
+    SelectScheduler(cfg.scheduler);
 
     std::string bandwidth = "2Mbps";
     std::string access_bandwidth = "10Mbps";
     std::string access_delay = "45ms";
     bool tracing = true;
-    std::string prefix_file_name = "scratch/resultados/Congestion_Control";
     uint64_t data_mbytes = 0;
     uint32_t mtu_bytes = 400;
-    double duration = 20.0;
-    uint32_t run = 0;
-    bool flow_monitor = true;
-    bool pcap = false;
+    double duration = cfg.duration;
+    if (cfg.monitor != "off" && cfg.monitor != "edge" && cfg.monitor != "full")
+    {
+        NS_FATAL_ERROR("monitor precisa ser off, edge ou full.");
+    }
+    bool flow_monitor = cfg.monitor == "full";
+    bool edge_monitor = cfg.monitor == "edge";
+    bool pcap = cfg.pcap;
     std::string queue_disc_type = "ns3::PfifoFastQueueDisc";
     std::string recovery = "ns3::TcpClassicRecovery";
 
     SeedManager::SetSeed(seed);
-    SeedManager::SetRun(run);
+    SeedManager::SetRun(cfg.run);
 
     // User may find it convenient to enable logging
     // LogComponentEnable("TcpVariantsComparison", LOG_LEVEL_ALL);
@@ -423,14 +1469,22 @@ main(int argc, char* argv[])
 
     PointToPointHelper link_bottleneck;
     link_bottleneck.SetDeviceAttribute("DataRate", StringValue(dataRate));
-    link_bottleneck.SetChannelAttribute("Delay", StringValue("100ms"));
+    link_bottleneck.SetChannelAttribute("Delay", StringValue(cfg.delay));
     link_bottleneck.SetDeviceAttribute("ReceiveErrorModel", PointerValue(error_model));
 
     NetDeviceContainer bottleneck_dev = link_bottleneck.Install(no2_no3);
 
+    profiler.Mark("topology");
     InternetStackHelper stack;
     stack.InstallAll(); // Possivel troca stack.Install(nodes)
 
+    // Streams fixos: o resultado nao depende de quantas execucoes vieram antes
+    // no mesmo processo (lote) nem de qual worker rodou o ponto
+    int64_t stream = cfg.streamBase;
+    stream += error_model->AssignStreams(stream);
+    stream += stack.AssignStreams(todos, stream);
+    profiler.Mark("stack");
+
 
     TrafficControlHelper tchPfifo;
     tchPfifo.SetRootQueueDisc("ns3::PfifoFastQueueDisc");
@@ -452,6 +1506,7 @@ main(int argc, char* argv[])
 
     // COnfigura servidor para responder da porta 8080 em diante
     uint16_t port = 8080;
+    ApplicationContainer sinkApps;
     for (uint32_t i = 0; i < nFlows; i++)
     {
         Address enderecos_servidor(InetSocketAddress(Ipv4Address::GetAny(), port+i));
@@ -459,13 +1514,17 @@ main(int argc, char* argv[])
         ApplicationContainer app_servidor = servidor.Install(todos.Get(3)); 
         app_servidor.Start(Seconds(0.0));
         app_servidor.Stop(Seconds(stop_time));
+        sinkApps.Add(app_servidor);
     }
 
+    profiler.Mark("addresses");
     NS_LOG_INFO("Initialize Global Routing.");
     Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+    profiler.Mark("routing");
 
     // Configura aplicativos cliente para requisitar na porta 8080 em diante do servidor
     port = 8080;
+    ApplicationContainer sourceApps;
     for (uint32_t i = 0; i < nFlows; i++)
     {
         AddressValue remoteAddress(InetSocketAddress(i23.GetAddress(1, 0), port+i));
@@ -478,99 +1537,173 @@ main(int argc, char* argv[])
         ApplicationContainer sourceApp = ftp.Install(todos.Get(0));
         sourceApp.Start(Seconds(0.0));
         sourceApp.Stop(Seconds(stop_time));
+        sourceApps.Add(sourceApp);
     }
 
     // Set up tracing if enabled
     if (tracing)
     {
-        std::ofstream ascii;
-        Ptr<OutputStreamWrapper> ascii_wrap;
-        ascii.open(prefix_file_name + "-ascii");
-        ascii_wrap = new OutputStreamWrapper(prefix_file_name + "-ascii", std::ios::out);
-        stack.EnableAsciiIpv4All(ascii_wrap);
+        // Um registro ASCII por evento IP so com ipTrace=ascii
+        if (cfg.ipTrace == "ascii")
+        {
+            AsciiTraceHelper ipAscii;
+            stack.EnableAsciiIpv4All(ipAscii.CreateFileStream(prefix_file_name + "-ascii"));
+        }
+        else if (cfg.ipTrace != "off")
+        {
+            ipTracer.Start(todos,
+                           cfg.ipTrace == "sampled",
+                           prefix_file_name,
+                           cfg.ipTraceInterval,
+                           cfg.ipTraceSample,
+                           port,
+                           nFlows);
+        }
+
+        if (traceFormat == "binary")
+        {
+            binaryTrace.Open(prefix_file_name + "-tcp.bin", traceCompress, 65536);
+        }
+        else
+        {
+            AsciiTraceHelper tcpAscii;
+            tcpTrace = tcpAscii.CreateFileStream(prefix_file_name + "-tcp.data");
+        }
 
-        for (uint16_t index = 0; index < nFlows; index++)
+        // Um slot por fluxo; os sockets sao ligados quando criados
+        for (uint32_t i = 0; i < nFlows; i++)
         {
-            std::string flowString;
-            if (nFlows > 1)
+            TraceFlow(sourceApps.Get(i), Seconds(0.0), sinkApps.Get(i));
+        }
+    }
+
+    if (pcap && cfg.pcapAsync)
+    {
+        pcapWriter.Start(cfg.pcapSnaplen,
+                         cfg.pcapRotateBytes,
+                         cfg.pcapRotateTime,
+                         cfg.pcapMaxFiles);
+        for (NetDeviceContainer devices : {dev0_dev1, bottleneck_dev, dev2_dev3})
+        {
+            for (uint32_t i = 0; i < devices.GetN(); ++i)
             {
-                flowString = "-flow" + std::to_string(index);
+                pcapWriter.Add(prefix_file_name, devices.Get(i));
             }
-
-            firstCwnd[0] = true;
-            firstSshThr[0] = true;
-            firstRtt[0] = true;
-            firstRto[0] = true;
-
-            firstCwnd[3] = true;
-            firstSshThr[3] = true;
-            firstRtt[3] = true;
-            firstRto[3] = true;
-
-            Simulator::Schedule(Seconds(start_time + 0.00001),
-                                &TraceCwnd,
-                                prefix_file_name + flowString + "-cwnd.data",
-                                0);
-            Simulator::Schedule(Seconds(start_time + 0.00001),
-                                &TraceSsThresh,
-                                prefix_file_name + flowString + "-ssth.data",
-                                0);
-            Simulator::Schedule(Seconds(start_time + 0.00001),
-                                &TraceRtt,
-                                prefix_file_name + flowString + "-rtt.data",
-                                0);
-            Simulator::Schedule(Seconds(start_time + 0.00001),
-                                &TraceRto,
-                                prefix_file_name + flowString + "-rto.data",
-                                0);
-            Simulator::Schedule(Seconds(start_time + 0.00001),
-                                &TraceNextTx,
-                                prefix_file_name + flowString + "-next-tx.data",
-                                0);
-            Simulator::Schedule(Seconds(start_time + 0.00001),
-                                &TraceInFlight,
-                                prefix_file_name + flowString + "-inflight.data",
-                                0);
-            Simulator::Schedule(Seconds(start_time + 0.1),
-                                &TraceNextRx,
-                                prefix_file_name + flowString + "-next-rx.data",
-                                3);
-        }
-    }
-
-    if (pcap)
+        }
+    }
+    else if (pcap)
     {
         links_normais.EnablePcapAll(prefix_file_name, true);
         link_bottleneck.EnablePcapAll(prefix_file_name, true);
     }
 
     // Flow monitor
+    profiler.Mark("apps");
     FlowMonitorHelper flowHelper;
     if (flow_monitor)
     {
         flowHelper.InstallAll();
     }
+    if (edge_monitor)
+    {
+        // Os fluxos vao do no 0 ao no 3, um por porta a partir de 8080
+        edgeMonitor.Start(NodeContainer(todos.Get(0)),
+                          NodeContainer(todos.Get(3)),
+                          8080,
+                          nFlows,
+                          false);
+    }
+    profiler.Mark("flowmonitor");
+
+    if (cfg.flowStats)
+    {
+        std::vector<Ptr<PacketSink>> sinks;
+        for (uint32_t i = 0; i < nFlows; i++)
+        {
+            sinks.push_back(DynamicCast<PacketSink>(sinkApps.Get(i)));
+        }
+        // Um unico caminho: todos os fluxos na mesma classe de RTT
+        flowStats.Start(sinks,
+                        std::vector<uint8_t>(nFlows, 0),
+                        Seconds(0.0),
+                        cfg.flowStatsBin,
+                        cfg.flowStatsBins,
+                        DataRate(dataRate).GetBitRate());
+    }
+
+    ConvergenceMonitor convergence;
+    if (cfg.convergeTolerance > 0)
+    {
+        std::vector<Ptr<PacketSink>> sinks;
+        for (uint32_t i = 0; i < nFlows; i++)
+        {
+            sinks.push_back(DynamicCast<PacketSink>(sinkApps.Get(i)));
+        }
+        convergence.Start(sinks,
+                          cfg.convergeWarmup,
+                          cfg.convergeBatch,
+                          cfg.convergeTolerance,
+                          cfg.convergeMinBatches);
+    }
+
+    if (forkSweep.IsEnabled())
+    {
+        forkSweep.Start(prefix_file_name, error_model, bottleneck_dev);
+    }
 
     Simulator::Stop(Seconds(stop_time));
+    auto runStart = std::chrono::steady_clock::now();
     Simulator::Run();
+    // Num filho do forkAt, as saidas daqui em diante sao as da variante
+    const SimConfig& runCfg = forkSweep.IsChild() ? forkSweep.Config() : cfg;
+    const std::string& outputPrefix = forkSweep.IsChild() ? forkSweep.Prefix() : prefix_file_name;
+    double runWallSeconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+    profiler.Mark("run");
+    FlushTraceReduction();
+    binaryTrace.Close();
+    traceTable.Clear();
+    tcpTrace = nullptr;
+    if (ipTracer.IsEnabled())
+    {
+        ipTracer.Finish();
+    }
+    if (pcapWriter.IsEnabled())
+    {
+        pcapWriter.Stop();
+        pcapWriter.Report(std::cout);
+    }
 
+    double simulatedSeconds = Simulator::Now().GetSeconds();
     double flowDuration = duration - start_time; 
+    if (convergence.IsEnabled())
+    {
+        convergence.Finish();
+        flowDuration = convergence.MeasuredSeconds();
+    }
+    if (flowStats.IsEnabled())
+    {
+        flowStats.Finish();
+    }
     uint64_t totalRxBytes = 0; 
 
-    Ptr<Node> destNode = todos.Get(3);
+    RunResult result;
+    result.rxBytes.assign(nFlows, 0);
     
     std::cout << "\n--- Resultados de Goodput por Fluxo ---" << std::endl;
 
     for (uint32_t flowIndex = 0; flowIndex < nFlows; ++flowIndex)
     {
-        Ptr<Application> genericApp = destNode->GetApplication(flowIndex);
+        Ptr<Application> genericApp = sinkApps.Get(flowIndex);
         
         Ptr<PacketSink> sinkApp = DynamicCast<PacketSink>(genericApp);
 
         if (sinkApp)
         {
-            uint64_t currentRxBytes = sinkApp->GetTotalRx();
+            uint64_t currentRxBytes = convergence.IsEnabled() ? convergence.RxBytes(flowIndex)
+                                                              : sinkApp->GetTotalRx();
             totalRxBytes += currentRxBytes;
+            result.rxBytes[flowIndex] = currentRxBytes;
             
             double goodputBps = (currentRxBytes * 8.0) / flowDuration; 
             
@@ -589,12 +1722,205 @@ main(int argc, char* argv[])
     double aggregateGoodput = (totalRxBytes * 8) / flowDuration;
     std::cout << "---" << std::endl;
     std::cout << "Goodput Agregado Total: " << aggregateGoodput << " bps" << std::endl;
-
+    if (flowStats.IsEnabled())
+    {
+        std::cout << "Justica (Jain): " << flowStats.Jain() << " | media por intervalo "
+                  << flowStats.MeanBinJain() << " | pior intervalo " << flowStats.MinBinJain()
+                  << std::endl;
+        for (uint32_t flowIndex = 0; flowIndex < nFlows; ++flowIndex)
+        {
+            std::cout << "Flow numero " << flowIndex + 1 << " | Parcela do gargalo: "
+                      << flowStats.Share(flowIndex) * 100 << "%" << std::endl;
+        }
+        flowStats.WriteSeries(outputPrefix + "-flowstats.data");
+    }
+    if (convergence.IsEnabled())
+    {
+        std::cout << "Convergencia: " << (convergence.Converged() ? "atingida" : "nao atingida")
+                  << " | precisao " << convergence.Precision() << " (tolerancia "
+                  << cfg.convergeTolerance << ") | " << convergence.Batches() << " lotes | "
+                  << simulatedSeconds << " s simulados de " << stop_time << " s" << std::endl;
+    }
     if (flow_monitor)
     {
-        flowHelper.SerializeToXmlFile(prefix_file_name + ".flowmonitor", true, true);
+        result.monitorBytesPerFlow = FlowMonitorBytesPerFlow(flowHelper.GetMonitor(), nFlows);
+        std::cout << "Flow monitor: " << result.monitorBytesPerFlow << " bytes/fluxo (edge usaria "
+                  << EdgeMonitor::BytesPerFlow() << ", economia de "
+                  << result.monitorBytesPerFlow - EdgeMonitor::BytesPerFlow() << " bytes/fluxo)"
+                  << std::endl;
+    }
+    if (edgeMonitor.IsEnabled())
+    {
+        result.monitorBytesPerFlow = EdgeMonitor::BytesPerFlow();
+        for (uint32_t flowIndex = 0; flowIndex < nFlows; ++flowIndex)
+        {
+            const EdgeFlowCounters& c = edgeMonitor.Flows()[flowIndex];
+            std::cout << "Flow numero " << flowIndex + 1 << " | Perdidos: "
+                      << c.txPackets - std::min(c.rxPackets, c.txPackets) << " | Atraso medio: "
+                      << (c.rxPackets ? c.delaySum * 1e-6 / c.rxPackets : 0)
+                      << " ms | Atraso maximo: " << c.delayMax * 1e-6 << " ms" << std::endl;
+        }
+        std::cout << "Monitor edge: " << result.monitorBytesPerFlow << " bytes/fluxo" << std::endl;
+        edgeMonitor.WriteCsv(outputPrefix + "-flows.csv");
     }
+    std::cout << "Eventos executados: " << Simulator::GetEventCount() << " ("
+              << Simulator::GetEventCount() / runWallSeconds << " eventos/s)" << std::endl;
 
+    profiler.Mark("results");
+    if (flow_monitor)
+    {
+        flowHelper.SerializeToXmlFile(outputPrefix + ".flowmonitor", true, true);
+    }
+    profiler.Mark("serialize");
+
+    result.aggregateGoodput = aggregateGoodput;
+    result.events = Simulator::GetEventCount();
+    result.wallSeconds = runWallSeconds;
+    result.flowDuration = flowDuration;
+    result.simulatedSeconds = simulatedSeconds;
+    if (flowStats.IsEnabled())
+    {
+        result.jain = flowStats.Jain();
+        result.meanBinJain = flowStats.MeanBinJain();
+        for (uint32_t i = 0; i < nFlows; ++i)
+        {
+            result.share.push_back(flowStats.Share(i));
+        }
+        result.rttImbalance = flowStats.ClassImbalance();
+    }
+    if (convergence.IsEnabled())
+    {
+        result.precision = convergence.Precision();
+        result.converged = convergence.Converged();
+    }
+    // Desmonta tudo para que a proxima execucao do lote comece do zero
+    flowStats = FlowStats();
+    edgeMonitor = EdgeMonitor();
+    ipTracer = IpTracer();
     Simulator::Destroy();
+    Ipv4AddressGenerator::Reset();
+    Config::Reset();
+    profiler.Mark("teardown");
+
+    result.phases = profiler.Phases();
+    profiler.Report(std::cout, simulatedSeconds, result.events);
+    if (forkSweep.IsChild())
+    {
+        forkSweep.Exit(FormatResult(runCfg, outputPrefix, result));
+    }
+    if (resultWriter.IsOpen())
+    {
+        resultWriter.WriteRecord(FormatResult(runCfg, outputPrefix, result));
+    }
+    if (forkSweep.IsEnabled())
+    {
+        forkSweep.Finish(std::cout);
+    }
+    return result;
+}
+
+/**
+ * Run every configuration of a parameter file in this process.
+ *
+ * Each non-empty line holds command-line options (with or without the leading
+ * "--") on top of the defaults, plus an optional seeds=a,b,c list of
+ * replications. Every run is written as a "run" record and every line as an
+ * "agg" record with the mean, standard deviation and 95% confidence interval
+ * over its replications.
+ *
+ * @param defaults Configuration the lines start from.
+ * @param batchFile Parameter file.
+ * @param batchOutput CSV output file.
+ */
+static void
+RunBatch(const SimConfig& defaults, const std::string& batchFile, const std::string& batchOutput)
+{
+    std::ifstream in(batchFile);
+    if (!in)
+    {
+        NS_FATAL_ERROR("Nao foi possivel abrir o arquivo de lote " << batchFile);
+    }
+    std::ofstream out(batchOutput);
+    if (!out)
+    {
+        NS_FATAL_ERROR("Nao foi possivel criar a saida do lote " << batchOutput);
+    }
+    out.precision(12);
+    out << BATCH_HEADER << std::endl;
+
+    std::string line;
+    uint32_t lineNo = 0;
+    while (std::getline(in, line))
+    {
+        lineNo++;
+        std::istringstream tokens(line);
+        std::vector<std::string> args{batchFile};
+        std::string token;
+        while (tokens >> token)
+        {
+            args.push_back(token.rfind("-", 0) == 0 ? token : "--" + token);
+        }
+        if (args.size() == 1 || args[1].rfind("--#", 0) == 0)
+        {
+            continue;
+        }
+
+        SimConfig cfg = defaults;
+        std::string seeds;
+        CommandLine lineCmd;
+        AddConfigValues(lineCmd, cfg);
+        lineCmd.AddValue("seeds", "Comma-separated seeds, one replication each", seeds);
+        lineCmd.Parse(args);
+
+        std::vector<uint32_t> seedList = seeds.empty() ? std::vector<uint32_t>{cfg.seed}
+                                                       : ParseSeeds(seeds);
+        BatchSamples samples;
+        for (uint32_t seed : seedList)
+        {
+            cfg.seed = seed;
+            std::string prefix = cfg.prefix + "-b" + std::to_string(lineNo) + "-s" +
+                                 std::to_string(seed);
+            RunResult result = RunSimulation(cfg, prefix);
+            WriteBatchRun(out, lineNo, cfg, result);
+            samples.Add(result);
+        }
+        WriteBatchSummary(out, lineNo, cfg, samples);
+    }
+}
+
+int
+main(int argc, char* argv[])
+{
+    SimConfig cfg;
+    std::string batchFile;
+    std::string batchOutput;
+    std::string resultFile;
+
+    CommandLine cmd(__FILE__);
+    AddConfigValues(cmd, cfg);
+    cmd.AddValue("batchFile",
+                 "Parameter file with one configuration (and seeds=a,b,c) per line; "
+                 "runs them all in this process",
+                 batchFile);
+    cmd.AddValue("batchOutput", "CSV file for the batch records", batchOutput);
+    cmd.AddValue("resultFile",
+                 "JSON result record of every run, one per line: file name, - (stdout) or fd:N",
+                 resultFile);
+    cmd.Parse(argc, argv);
+
+    if (!resultFile.empty())
+    {
+        resultWriter.Open(resultFile);
+    }
+
+    if (batchFile.empty())
+    {
+        RunSimulation(cfg, cfg.prefix);
+    }
+    else
+    {
+        RunBatch(cfg, batchFile, batchOutput.empty() ? batchFile + ".csv" : batchOutput);
+    }
+    resultWriter.Close();
     return 0;
 }
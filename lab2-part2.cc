@@ -1,3 +1,6 @@
+#include "lab-common.h"
+#include "lab2-common.h"
+
 #include "ns3/applications-module.h"
 #include "ns3/core-module.h"
 #include "ns3/enum.h"
@@ -5,6 +8,7 @@
 #include "ns3/event-id.h"
 #include "ns3/flow-monitor-helper.h"
 #include "ns3/internet-module.h"
+#include "ns3/ipv4-flow-classifier.h"
 #include "ns3/ipv4-global-routing-helper.h"
 #include "ns3/network-module.h"
 #include "ns3/point-to-point-module.h"
@@ -12,319 +16,534 @@
 #include "ns3/traffic-control-module.h"
 #include "ns3/udp-header.h"
 
+#ifdef NS3_MPI
+#include "ns3/mpi-interface.h"
+
+#include <mpi.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 
 using namespace ns3;
 
 NS_LOG_COMPONENT_DEFINE("TcpVariantsComparison");
 
-static std::map<uint32_t, bool> firstCwnd;                      //!< First congestion window.
-static std::map<uint32_t, bool> firstSshThr;                    //!< First SlowStart threshold.
-static std::map<uint32_t, bool> firstRtt;                       //!< First RTT.
-static std::map<uint32_t, bool> firstRto;                       //!< First RTO.
-static std::map<uint32_t, Ptr<OutputStreamWrapper>> cWndStream; //!< Congstion window output stream.
-static std::map<uint32_t, Ptr<OutputStreamWrapper>>
-    ssThreshStream; //!< SlowStart threshold output stream.
-static std::map<uint32_t, Ptr<OutputStreamWrapper>> rttStream;      //!< RTT output stream.
-static std::map<uint32_t, Ptr<OutputStreamWrapper>> rtoStream;      //!< RTO output stream.
-static std::map<uint32_t, Ptr<OutputStreamWrapper>> nextTxStream;   //!< Next TX output stream.
-static std::map<uint32_t, Ptr<OutputStreamWrapper>> nextRxStream;   //!< Next RX output stream.
-static std::map<uint32_t, Ptr<OutputStreamWrapper>> inFlightStream; //!< In flight output stream.
-static std::map<uint32_t, uint32_t> cWndValue;                      //!< congestion window value.
-static std::map<uint32_t, uint32_t> ssThreshValue;                  //!< SlowStart threshold value.
+static const char* const PROGRAM_NAME = "lab2-part2"; //!< Name in the result records.
 
 /**
- * Get the Node Id From Context.
- *
- * @param context The context.
- * @return the node ID.
+ * Parameters of one simulation run.
  */
-static uint32_t
-GetNodeIdFromContext(std::string context)
+struct SimConfig
 {
-    const std::size_t n1 = context.find_first_of('/', 1);
-    const std::size_t n2 = context.find_first_of('/', n1 + 1);
-    return std::stoul(context.substr(n1 + 1, n2 - n1 - 1));
-}
+    std::string transport_prot = "TcpCubic"; //!< Transport protocol.
+    double errorRate = 0.00001;              //!< Bottleneck error rate.
+    std::string delay = "20ms";              //!< Bottleneck delay.
+    std::string dataRate = "1Mbps";          //!< Bottleneck data rate.
+    uint32_t nFlows = 4;                     //!< Number of flows, split between the destinations.
+    uint32_t seed = 123456789;               //!< RNG seed.
+    bool bulkSetup = false;                  //!< One sink per destination, flows demultiplexed by port.
+    uint16_t bulkPortBase = 10000;           //!< Local port of flow 0 in bulkSetup mode.
+    bool distributed = false;                //!< Partition the topology over the MPI ranks.
+    uint32_t run = 1;                        //!< RNG run number.
+    int64_t streamBase = 0;                  //!< First explicit RNG stream.
+    std::string prefix;                      //!< Output file prefix (empty: derived from the protocol).
+    double duration = 20.0;                  //!< Simulated time of the flows (cap in convergence mode).
+    double convergeTolerance = 0;            //!< Relative CI half-width to stop at (0 = off).
+    Time convergeWarmup = Seconds(2);        //!< Warm-up left out of the goodput.
+    Time convergeBatch = Seconds(1);         //!< Batch length of the convergence test.
+    uint32_t convergeMinBatches = 5;         //!< Batches before the test is applied.
+    bool flowStats = false;                  //!< Collect per-flow goodput statistics.
+    Time flowStatsBin = MilliSeconds(100);   //!< Bin width of the goodput time series.
+    uint32_t flowStatsBins = 1024;           //!< Bins kept per flow.
+    std::string monitor = "full";            //!< Flow monitoring level (off, edge, full).
+    bool profile = false;                    //!< Time the phases of the run.
+    std::string scheduler = "map";           //!< Event scheduler.
+    std::string traceFormat = "text";        //!< TCP trace sink.
+    bool traceCompress = false;              //!< Gzip the binary trace.
+    std::string traceMode = "full";          //!< Trace reduction mode.
+    double traceThreshold = 0.05;            //!< Change mode threshold.
+    Time traceBucket = MilliSeconds(10);     //!< Bucket mode width.
+};
 
 /**
- * Congestion window tracer.
- *
- * @param context The context.
- * @param oldval Old value.
- * @param newval New value.
+ * Results of one simulation run.
  */
-static void
-CwndTracer(std::string context, uint32_t oldval, uint32_t newval)
+struct RunResult
 {
-    uint32_t nodeId = GetNodeIdFromContext(context);
+    std::vector<uint64_t> rxBytes; //!< Bytes received by the sink of each flow.
+    double aggregateGoodput{0};    //!< Aggregate goodput of both destinations, in bps.
+    double avgGoodputDest1{0};     //!< Average per-flow goodput towards dest1, in bps.
+    double avgGoodputDest2{0};     //!< Average per-flow goodput towards dest2, in bps.
+    double flowDuration{0};        //!< Interval the goodput is measured over, in seconds.
+    uint64_t events{0};            //!< Events executed by Simulator::Run.
+    double wallSeconds{0};         //!< Wall-clock time of Simulator::Run, in seconds.
+    double precision{0};           //!< Worst relative CI half-width reached (convergence mode).
+    double simulatedSeconds{0};    //!< Simulated time actually used, in seconds.
+    bool converged{false};         //!< Tolerance reached before the cap.
+    double jain{0};                //!< Jain's fairness index of the per-flow goodput (flowStats).
+    double meanBinJain{0};         //!< Mean per-bin Jain's index (flowStats).
+    std::vector<double> share;     //!< Fraction of the bottleneck each flow obtained (flowStats).
+    double rttImbalance{0};        //!< Fast-class over slow-class goodput (flowStats).
+    double monitorBytesPerFlow{0}; //!< Flow monitor state per flow, in bytes (monitor).
+    double setupSeconds{0};        //!< Wall-clock time of the topology and flow setup.
+    double setupBytesPerFlow{0};   //!< Resident memory added by the setup, per flow.
+    double peakBytesPerFlow{0};    //!< Peak RSS over the start of the run, per flow (NaN if unknown).
+    uint32_t ranks{1};             //!< MPI ranks the topology was partitioned over.
+
+    std::vector<std::pair<const char*, double>> phases; //!< Wall-clock time per phase (profile).
+};
 
-    if (firstCwnd[nodeId])
+/**
+ * Format the result record of one run (resultFile).
+ *
+ * @param cfg The configuration of the run.
+ * @param prefix Prefix of the output files of the run.
+ * @param result The result of the run.
+ * @return the JSON record, newline included.
+ */
+static std::string
+FormatResult(const SimConfig& cfg, const std::string& prefix, const RunResult& result)
+{
+    JsonObject params;
+    params
+        .Field("transport_prot", cfg.transport_prot)
+        .Field("errorRate", cfg.errorRate)
+        .Field("delay", cfg.delay)
+        .Field("dataRate", cfg.dataRate)
+        .Field("nFlows", cfg.nFlows)
+        .Field("seed", cfg.seed)
+        .Field("bulkSetup", cfg.bulkSetup)
+        .Field("bulkPortBase", cfg.bulkPortBase)
+        .Field("distributed", cfg.distributed)
+        .Field("run", cfg.run)
+        .Field("streamBase", cfg.streamBase)
+        .Field("prefix", cfg.prefix)
+        .Field("duration", cfg.duration)
+        .Field("convergeTolerance", cfg.convergeTolerance)
+        .Field("convergeWarmup", cfg.convergeWarmup)
+        .Field("convergeBatch", cfg.convergeBatch)
+        .Field("convergeMinBatches", cfg.convergeMinBatches)
+        .Field("flowStats", cfg.flowStats)
+        .Field("flowStatsBin", cfg.flowStatsBin)
+        .Field("flowStatsBins", cfg.flowStatsBins)
+        .Field("monitor", cfg.monitor)
+        .Field("profile", cfg.profile)
+        .Field("scheduler", cfg.scheduler)
+        .Field("traceFormat", cfg.traceFormat)
+        .Field("traceCompress", cfg.traceCompress)
+        .Field("traceMode", cfg.traceMode)
+        .Field("traceThreshold", cfg.traceThreshold)
+        .Field("traceBucket", cfg.traceBucket);
+
+    std::vector<double> goodput;
+    for (uint64_t rx : result.rxBytes)
     {
-        *cWndStream[nodeId]->GetStream() << "0.0 " << oldval << std::endl;
-        firstCwnd[nodeId] = false;
+        goodput.push_back(rx * 8.0 / result.flowDuration);
     }
-    *cWndStream[nodeId]->GetStream() << Simulator::Now().GetSeconds() << " " << newval << std::endl;
-    cWndValue[nodeId] = newval;
-
-    if (!firstSshThr[nodeId])
+    JsonObject record;
+    record.Field("program", PROGRAM_NAME)
+        .Field("prefix", prefix)
+        .Object("params", params)
+        .Field("seed", cfg.seed)
+        .Field("run", cfg.run)
+        .Field("flowDuration", result.flowDuration)
+        .Array("rxBytes", result.rxBytes)
+        .Array("goodput", goodput)
+        .Field("aggregateGoodput", result.aggregateGoodput)
+        .Field("avgGoodputDest1", result.avgGoodputDest1)
+        .Field("avgGoodputDest2", result.avgGoodputDest2)
+        .Field("simulatedSeconds", result.simulatedSeconds);
+    if (cfg.convergeTolerance > 0)
+    {
+        record.Field("precision", result.precision).Field("converged", result.converged);
+    }
+    if (cfg.flowStats)
+    {
+        record.Field("jain", result.jain)
+            .Field("meanBinJain", result.meanBinJain)
+            .Array("share", result.share);
+        if (result.rttImbalance > 0)
+        {
+            record.Field("rttImbalance", result.rttImbalance);
+        }
+    }
+    record.Field("setupSeconds", result.setupSeconds)
+        .Field("setupBytesPerFlow", result.setupBytesPerFlow)
+        .Field("peakBytesPerFlow", result.peakBytesPerFlow)
+        .Field("ranks", result.ranks);
+    if (result.monitorBytesPerFlow > 0)
+    {
+        record.Field("monitorBytesPerFlow", result.monitorBytesPerFlow);
+    }
+    if (!result.phases.empty())
     {
-        *ssThreshStream[nodeId]->GetStream()
-            << Simulator::Now().GetSeconds() << " " << ssThreshValue[nodeId] << std::endl;
+        JsonObject phases;
+        for (const auto& [phase, seconds] : result.phases)
+        {
+            phases.Field(phase, seconds);
+        }
+        record.Object("phases", phases);
     }
+    record.Field("events", result.events).Field("wallSeconds", result.wallSeconds);
+    return record.Str() + "\n";
 }
 
 /**
- * Slow start threshold tracer.
+ * Register the trace options of a configuration on a command line.
  *
- * @param context The context.
- * @param oldval Old value.
- * @param newval New value.
+ * @param cmd The command line.
+ * @param cfg The configuration that receives the parsed values.
  */
 static void
-SsThreshTracer(std::string context, uint32_t oldval, uint32_t newval)
+AddTraceValues(CommandLine& cmd, SimConfig& cfg)
 {
-    uint32_t nodeId = GetNodeIdFromContext(context);
-
-    if (firstSshThr[nodeId])
-    {
-        *ssThreshStream[nodeId]->GetStream() << "0.0 " << oldval << std::endl;
-        firstSshThr[nodeId] = false;
-    }
-    *ssThreshStream[nodeId]->GetStream()
-        << Simulator::Now().GetSeconds() << " " << newval << std::endl;
-    ssThreshValue[nodeId] = newval;
-
-    if (!firstCwnd[nodeId])
-    {
-        *cWndStream[nodeId]->GetStream()
-            << Simulator::Now().GetSeconds() << " " << cWndValue[nodeId] << std::endl;
-    }
+    cmd.AddValue("traceFormat",
+                 "TCP trace sink: text (one .data file per metric) or binary (buffered records)",
+                 cfg.traceFormat);
+    cmd.AddValue("traceCompress", "Compress the binary trace with gzip", cfg.traceCompress);
+    cmd.AddValue("traceMode",
+                 "Trace reduction: full (every sample), change (only changes beyond "
+                 "traceThreshold) or bucket (min/max/last per traceBucket)",
+                 cfg.traceMode);
+    cmd.AddValue("traceThreshold",
+                 "Relative change that triggers a sample in change mode",
+                 cfg.traceThreshold);
+    cmd.AddValue("traceBucket", "Time bucket width in bucket mode", cfg.traceBucket);
 }
 
 /**
- * RTT tracer.
+ * Register the scenario options of a configuration on a command line.
  *
- * @param context The context.
- * @param oldval Old value.
- * @param newval New value.
+ * @param cmd The command line.
+ * @param cfg The configuration that receives the parsed values.
  */
 static void
-RttTracer(std::string context, Time oldval, Time newval)
+AddConfigValues(CommandLine& cmd, SimConfig& cfg)
 {
-    uint32_t nodeId = GetNodeIdFromContext(context);
-
-    if (firstRtt[nodeId])
-    {
-        *rttStream[nodeId]->GetStream() << "0.0 " << oldval.GetSeconds() << std::endl;
-        firstRtt[nodeId] = false;
-    }
-    *rttStream[nodeId]->GetStream()
-        << Simulator::Now().GetSeconds() << " " << newval.GetSeconds() << std::endl;
+    cmd.AddValue("transport_prot", "Transport protocol to use: TcpCubic or TcpNewReno", cfg.transport_prot);
+    cmd.AddValue("errorRate", "Bottleneck link error rate", cfg.errorRate);
+    cmd.AddValue("delay", "Bottleneck delay", cfg.delay);
+    cmd.AddValue("dataRate", "Bottleneck data Rate", cfg.dataRate);
+    cmd.AddValue("nFlows", "Number of flows (must be even)", cfg.nFlows);
+    cmd.AddValue("seed", "Seed for simulation", cfg.seed);
+    cmd.AddValue("run", "RNG run number (independent substream of the seed)", cfg.run);
+    cmd.AddValue("streamBase",
+                 "First RNG stream assigned explicitly to the random variables of the topology",
+                 cfg.streamBase);
+    cmd.AddValue("bulkSetup",
+                 "Provision the flows in one pass: one listening sink per destination, "
+                 "flows told apart by their source port (for thousands of flows)",
+                 cfg.bulkSetup);
+    cmd.AddValue("bulkPortBase", "Source port of flow 0 in bulkSetup mode", cfg.bulkPortBase);
+    cmd.AddValue("distributed",
+                 "Partition the topology over the MPI ranks (mpirun -np N; needs an MPI build)",
+                 cfg.distributed);
+    cmd.AddValue("duration",
+                 "Simulated time of the flows, in seconds; hard cap when convergeTolerance is set",
+                 cfg.duration);
+    cmd.AddValue("convergeTolerance",
+                 "Stop once the 95% CI of every flow's batch-mean goodput is within this "
+                 "fraction of the mean (0 = always simulate the full duration)",
+                 cfg.convergeTolerance);
+    cmd.AddValue("convergeWarmup",
+                 "Warm-up after the flows start that is left out of the goodput",
+                 cfg.convergeWarmup);
+    cmd.AddValue("convergeBatch", "Batch length of the convergence test", cfg.convergeBatch);
+    cmd.AddValue("convergeMinBatches",
+                 "Batches required before the convergence test is applied",
+                 cfg.convergeMinBatches);
+    cmd.AddValue("flowStats",
+                 "Collect per-flow goodput statistics (time series, Jain's index, shares)",
+                 cfg.flowStats);
+    cmd.AddValue("flowStatsBin", "Bin width of the per-flow goodput time series", cfg.flowStatsBin);
+    cmd.AddValue("flowStatsBins", "Bins kept per flow (ring buffer)", cfg.flowStatsBins);
+    cmd.AddValue("monitor",
+                 "Flow monitoring: off, edge (per-flow counters at the source and sink, "
+                 "written to <prefix>-flows.csv) or full (FlowMonitor XML)",
+                 cfg.monitor);
+    cmd.AddValue("profile",
+                 "Time each phase of the run (setup, routing, Simulator::Run, output) and "
+                 "report events/s and simulated seconds per wall second",
+                 cfg.profile);
+    cmd.AddValue("scheduler",
+                 "Event scheduler: map, list, heap, calendar or priority",
+                 cfg.scheduler);
+    cmd.AddValue("outputPrefix",
+                 "Prefix (directory and base name) of the output files; "
+                 "defaults to lab2-part2-<prot>-<nFlows>",
+                 cfg.prefix);
+    AddTraceValues(cmd, cfg);
 }
 
 /**
- * RTO tracer.
+ * Apply the trace options of a configuration to the tracer globals.
  *
- * @param context The context.
- * @param oldval Old value.
- * @param newval New value.
+ * @param cfg The configuration.
  */
 static void
-RtoTracer(std::string context, Time oldval, Time newval)
+ApplyTraceConfig(const SimConfig& cfg)
 {
-    uint32_t nodeId = GetNodeIdFromContext(context);
-
-    if (firstRto[nodeId])
+    if (cfg.traceFormat != "text" && cfg.traceFormat != "binary")
+    {
+        NS_FATAL_ERROR("traceFormat precisa ser text ou binary.");
+    }
+    if (cfg.traceMode == "full")
+    {
+        reductionMode = TRACE_FULL;
+    }
+    else if (cfg.traceMode == "change")
+    {
+        reductionMode = TRACE_CHANGE;
+    }
+    else if (cfg.traceMode == "bucket")
+    {
+        reductionMode = TRACE_BUCKET;
+    }
+    else
+    {
+        NS_FATAL_ERROR("traceMode precisa ser full, change ou bucket.");
+    }
+    if (!cfg.traceBucket.IsStrictlyPositive())
     {
-        *rtoStream[nodeId]->GetStream() << "0.0 " << oldval.GetSeconds() << std::endl;
-        firstRto[nodeId] = false;
+        NS_FATAL_ERROR("traceBucket precisa ser positivo.");
     }
-    *rtoStream[nodeId]->GetStream()
-        << Simulator::Now().GetSeconds() << " " << newval.GetSeconds() << std::endl;
+    traceThreshold = cfg.traceThreshold;
+    traceBucketNs = cfg.traceBucket.GetNanoSeconds();
 }
 
 /**
- * Next TX tracer.
- *
- * @param context The context.
- * @param old Old sequence number.
- * @param nextTx Next sequence number.
+ * CSV header of the batch output.
  */
-static void
-NextTxTracer(std::string context, SequenceNumber32 old [[maybe_unused]], SequenceNumber32 nextTx)
-{
-    uint32_t nodeId = GetNodeIdFromContext(context);
+static const char* const BATCH_HEADER =
+    "record,line,seed,runs,transport_prot,nFlows,delay,dataRate,errorRate,"
+    "goodput,goodput_sd,goodput_ci95,goodput_avg_d1,goodput_avg_d1_sd,goodput_avg_d1_ci95,"
+    "goodput_avg_d2,goodput_avg_d2_sd,goodput_avg_d2_ci95,events,wall_s";
 
-    *nextTxStream[nodeId]->GetStream()
-        << Simulator::Now().GetSeconds() << " " << nextTx << std::endl;
-}
+/**
+ * Goodput samples of the replications of one batch line.
+ */
+struct BatchSamples
+{
+    std::vector<double> goodput;      //!< Aggregate goodput of each run.
+    std::vector<double> goodputDest1; //!< Average per-flow goodput towards dest1 of each run.
+    std::vector<double> goodputDest2; //!< Average per-flow goodput towards dest2 of each run.
+    uint64_t events{0};               //!< Events executed, summed over the runs.
+    double wallSeconds{0};            //!< Wall-clock time, summed over the runs.
+
+    /**
+     * Add the result of one run.
+     *
+     * @param result The result.
+     */
+    void Add(const RunResult& result)
+    {
+        goodput.push_back(result.aggregateGoodput);
+        goodputDest1.push_back(result.avgGoodputDest1);
+        goodputDest2.push_back(result.avgGoodputDest2);
+        events += result.events;
+        wallSeconds += result.wallSeconds;
+    }
+};
 
 /**
- * In flight tracer.
+ * Write the configuration columns of a batch record.
  *
- * @param context The context.
- * @param old Old value.
- * @param inFlight In flight value.
+ * @param out CSV output.
+ * @param cfg The configuration.
  */
 static void
-InFlightTracer(std::string context, uint32_t old [[maybe_unused]], uint32_t inFlight)
+WriteBatchConfig(std::ostream& out, const SimConfig& cfg)
 {
-    uint32_t nodeId = GetNodeIdFromContext(context);
-
-    *inFlightStream[nodeId]->GetStream()
-        << Simulator::Now().GetSeconds() << " " << inFlight << std::endl;
+    out << cfg.transport_prot << "," << cfg.nFlows << "," << cfg.delay << "," << cfg.dataRate
+        << "," << cfg.errorRate;
 }
 
 /**
- * Next RX tracer.
+ * Write the record of one batch run.
  *
- * @param context The context.
- * @param old Old sequence number.
- * @param nextRx Next sequence number.
+ * @param out CSV output.
+ * @param line Line of the parameter file.
+ * @param cfg The configuration of the run.
+ * @param result The result of the run.
  */
 static void
-NextRxTracer(std::string context, SequenceNumber32 old [[maybe_unused]], SequenceNumber32 nextRx)
+WriteBatchRun(std::ostream& out, uint32_t line, const SimConfig& cfg, const RunResult& result)
 {
-    uint32_t nodeId = GetNodeIdFromContext(context);
-
-    *nextRxStream[nodeId]->GetStream()
-        << Simulator::Now().GetSeconds() << " " << nextRx << std::endl;
+    out << "run," << line << "," << cfg.seed << ",1,";
+    WriteBatchConfig(out, cfg);
+    out << "," << result.aggregateGoodput << ",,," << result.avgGoodputDest1 << ",,,"
+        << result.avgGoodputDest2 << ",,," << result.events << "," << result.wallSeconds
+        << std::endl;
 }
 
 /**
- * Congestion window trace connection.
+ * Write the columns of one summarized metric.
  *
- * @param cwnd_tr_file_name Congestion window trace file name.
- * @param nodeId Node ID.
+ * @param out CSV output.
+ * @param s The summary.
  */
 static void
-TraceCwnd(std::string cwnd_tr_file_name, uint32_t nodeId, uint32_t socketIndex)
+WriteSummary(std::ostream& out, const Summary& s)
 {
-    AsciiTraceHelper ascii;
-    cWndStream[nodeId] = ascii.CreateFileStream(cwnd_tr_file_name);
-    Config::Connect("/NodeList/" + std::to_string(nodeId) +
-                        "/$ns3::TcpL4Protocol/SocketList/" + std::to_string(socketIndex) + "/CongestionWindow",
-                    MakeCallback(&CwndTracer));
+    out << "," << s.mean << "," << s.stddev << "," << s.ci95;
 }
 
 /**
- * Slow start threshold trace connection.
+ * Write the aggregate record of one batch line.
  *
- * @param ssthresh_tr_file_name Slow start threshold trace file name.
- * @param nodeId Node ID.
+ * @param out CSV output.
+ * @param line Line of the parameter file.
+ * @param cfg The configuration of the line.
+ * @param samples The samples of its replications.
  */
 static void
-TraceSsThresh(std::string ssthresh_tr_file_name, uint32_t nodeId, uint32_t socketIndex)
+WriteBatchSummary(std::ostream& out,
+                  uint32_t line,
+                  const SimConfig& cfg,
+                  const BatchSamples& samples)
 {
-    AsciiTraceHelper ascii;
-    ssThreshStream[nodeId] = ascii.CreateFileStream(ssthresh_tr_file_name);
-    Config::Connect("/NodeList/" + std::to_string(nodeId) +
-                        "/$ns3::TcpL4Protocol/SocketList/" + std::to_string(socketIndex) + "/SlowStartThreshold",
-                    MakeCallback(&SsThreshTracer));
+    out << "agg," << line << ",," << samples.goodput.size() << ",";
+    WriteBatchConfig(out, cfg);
+    WriteSummary(out, Summarize(samples.goodput));
+    WriteSummary(out, Summarize(samples.goodputDest1));
+    WriteSummary(out, Summarize(samples.goodputDest2));
+    out << "," << samples.events << "," << samples.wallSeconds << std::endl;
 }
 
 /**
- * RTT trace connection.
- *
- * @param rtt_tr_file_name RTT trace file name.
- * @param nodeId Node ID.
+ * Per-flow byte counters of the bulk-provisioned flows (bulkSetup).
  */
-static void
-TraceRtt(std::string rtt_tr_file_name, uint32_t nodeId, uint32_t socketIndex)
+struct BulkFlowTable
 {
-    AsciiTraceHelper ascii;
-    rttStream[nodeId] = ascii.CreateFileStream(rtt_tr_file_name);
-    Config::Connect("/NodeList/" + std::to_string(nodeId) + "/$ns3::TcpL4Protocol/SocketList/" + std::to_string(socketIndex) + "/RTT",
-                    MakeCallback(&RttTracer));
-}
+    uint16_t portBase{0};          //!< Source port of flow 0.
+    std::vector<uint64_t> rxBytes; //!< Bytes received from each flow.
+};
+
+static BulkFlowTable bulkFlows; //!< Counters of the bulkSetup flows.
 
 /**
- * RTO trace connection.
+ * RxWithAddresses trace of a shared sink: account the packet to the flow its
+ * source port belongs to.
  *
- * @param rto_tr_file_name RTO trace file name.
- * @param nodeId Node ID.
+ * @param packet The received packet.
+ * @param from Sender address and port.
+ * @param local Local address.
  */
 static void
-TraceRto(std::string rto_tr_file_name, uint32_t nodeId, uint32_t socketIndex)
+BulkFlowRx(Ptr<const Packet> packet, const Address& from, const Address& local [[maybe_unused]])
 {
-    AsciiTraceHelper ascii;
-    rtoStream[nodeId] = ascii.CreateFileStream(rto_tr_file_name);
-    Config::Connect("/NodeList/" + std::to_string(nodeId) + "/$ns3::TcpL4Protocol/SocketList/" + std::to_string(socketIndex) + "/RTO",
-                    MakeCallback(&RtoTracer));
+    uint32_t flow = InetSocketAddress::ConvertFrom(from).GetPort() - bulkFlows.portBase;
+    if (flow < bulkFlows.rxBytes.size())
+    {
+        bulkFlows.rxBytes[flow] += packet->GetSize();
+    }
 }
 
 /**
- * Next TX trace connection.
+ * Reset the peak resident memory of this process to its current resident
+ * memory (Linux clear_refs), so that PeakResidentBytes() covers only what
+ * follows. Without it the peak would include the earlier runs of a batch.
  *
- * @param next_tx_seq_file_name Next TX trace file name.
- * @param nodeId Node ID.
+ * @return true if the kernel accepted the reset.
  */
-static void
-TraceNextTx(std::string& next_tx_seq_file_name, uint32_t nodeId, uint32_t socketIndex)
+static bool
+ResetPeakResident()
 {
-    AsciiTraceHelper ascii;
-    nextTxStream[nodeId] = ascii.CreateFileStream(next_tx_seq_file_name);
-    Config::Connect("/NodeList/" + std::to_string(nodeId) +
-                        "/$ns3::TcpL4Protocol/SocketList/" + std::to_string(socketIndex) + "/NextTxSequence",
-                    MakeCallback(&NextTxTracer));
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5" << std::flush;
+    return clearRefs.good();
 }
 
 /**
- * In flight trace connection.
- *
- * @param in_flight_file_name In flight trace file name.
- * @param nodeId Node ID.
+ * @return peak resident memory of this process since the last
+ *         ResetPeakResident() (VmHWM), in bytes, or 0 if unknown.
  */
-static void
-TraceInFlight(std::string& in_flight_file_name, uint32_t nodeId, uint32_t socketIndex)
+static uint64_t
+PeakResidentBytes()
 {
-    AsciiTraceHelper ascii;
-    inFlightStream[nodeId] = ascii.CreateFileStream(in_flight_file_name);
-    Config::Connect("/NodeList/" + std::to_string(nodeId) +
-                        "/$ns3::TcpL4Protocol/SocketList/" + std::to_string(socketIndex) + "/BytesInFlight",
-                    MakeCallback(&InFlightTracer));
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.rfind("VmHWM:", 0) == 0)
+        {
+            return std::stoull(line.substr(6)) * 1024;
+        }
+    }
+    return 0;
 }
 
 /**
- * Next RX trace connection.
+ * Partition of each node of the topology: source, n1, n2, dest1, dest2.
  *
- * @param next_rx_seq_file_name Next RX trace file name.
- * @param nodeId Node ID.
+ * The cuts are the bottleneck (n1-n2) and the slow dest2 link, so the
+ * lookahead the distributed simulator derives from the remote channels is the
+ * smaller of the two propagation delays. The 0.01 ms links stay inside a rank.
  */
-static void
-TraceNextRx(std::string& next_rx_seq_file_name, uint32_t nodeId, uint32_t socketIndex)
+static const uint32_t NODE_PARTITION[5] = {0, 0, 1, 1, 2};
+
+/**
+ * @param cfg The configuration.
+ * @return number of ranks the topology is partitioned over.
+ */
+static uint32_t
+RankCount(const SimConfig& cfg [[maybe_unused]])
 {
-    AsciiTraceHelper ascii;
-    nextRxStream[nodeId] = ascii.CreateFileStream(next_rx_seq_file_name);
-    Config::Connect("/NodeList/" + std::to_string(nodeId) +
-                        "/$ns3::TcpL4Protocol/SocketList/" + std::to_string(socketIndex) + "/RxBuffer/NextRxSequence",
-                    MakeCallback(&NextRxTracer));
+#ifdef NS3_MPI
+    if (cfg.distributed)
+    {
+        return MpiInterface::GetSize();
+    }
+#endif
+    return 1;
 }
 
-int
-main(int argc, char* argv[])
+/**
+ * @param cfg The configuration.
+ * @return rank of this process (0 when not distributed).
+ */
+static uint32_t
+LocalRank(const SimConfig& cfg [[maybe_unused]])
 {
-    
-    std::string dataRate = "1Mbps"; 
-    std::string delay = "20ms";     
-    double errorRate = 0.00001;
-    uint32_t nFlows = 4; 
-    std::string transport_prot = "TcpCubic";
-    uint32_t seed = 123456789; 
-
-    CommandLine cmd(__FILE__);
-    cmd.AddValue("transport_prot", "Transport protocol to use: TcpCubic or TcpNewReno", transport_prot);
-    cmd.AddValue("errorRate", "Bottleneck link error rate", errorRate);
-    cmd.AddValue("delay", "Bottleneck delay", delay);
-    cmd.AddValue("dataRate", "Bottleneck data Rate", dataRate);
-    cmd.AddValue("nFlows", "Number of flows (must be even)", nFlows);
-    cmd.AddValue("seed", "Seed for simulation", seed);
-    cmd.Parse(argc, argv);
+#ifdef NS3_MPI
+    if (cfg.distributed)
+    {
+        return MpiInterface::GetSystemId();
+    }
+#endif
+    return 0;
+}
 
+/**
+ * Build the topology, run one simulation and tear it down again.
+ *
+ * @param cfg Parameters of the run.
+ * @param prefix_file_name Prefix of the output files.
+ * @return the results of the run.
+ */
+static RunResult
+RunSimulation(const SimConfig& cfg, const std::string& prefix_file_name)
+{
+    const std::string& dataRate = cfg.dataRate;
+    const std::string& delay = cfg.delay;
+    double errorRate = cfg.errorRate;
+    uint32_t nFlows = cfg.nFlows;
+    const std::string& transport_prot = cfg.transport_prot;
+    uint32_t seed = cfg.seed;
+    const std::string& traceFormat = cfg.traceFormat;
+    bool traceCompress = cfg.traceCompress;
+    ApplyTraceConfig(cfg);
+    profiler.Start(cfg.profile);
+    SelectScheduler(cfg.scheduler);
     
     if (nFlows % 2 != 0 || nFlows < 0)
     {
@@ -332,19 +551,49 @@ main(int argc, char* argv[])
     }
     uint32_t flows_per_dest = nFlows / 2;
 
-    std::string prefix_file_name = "lab2-part2-" + transport_prot + "-" + std::to_string(nFlows);
     uint64_t data_mbytes = 0;
     uint32_t mtu_bytes = 400;
-    double duration = 20.0;
+    double duration = cfg.duration;
     double start_time = 1.0; 
     double stop_time = start_time + duration;
 
-    bool tracing = true;
-    bool flow_monitor = true;
+    // Os traces TCP e o flow monitor precisam das duas pontas de cada fluxo
+    // no mesmo processo
+    // Com bulkSetup os fluxos nao tem sink proprio, e o flow monitor guardaria
+    // estado por fluxo que a medicao de memoria nao deve contar
+    bool tracing = !cfg.distributed && !cfg.bulkSetup;
+    // O monitor edge so precisa das duas pontas e serve tambem para bulkSetup
+    bool flow_monitor = cfg.monitor == "full" && !cfg.distributed && !cfg.bulkSetup;
+    bool edge_monitor = cfg.monitor == "edge";
+    uint32_t rank = LocalRank(cfg);
+    uint32_t ranks = RankCount(cfg);
+    if (cfg.distributed && (cfg.flowStats || cfg.convergeTolerance > 0))
+    {
+        NS_FATAL_ERROR("flowStats e convergeTolerance nao funcionam com distributed.");
+    }
+    if (cfg.monitor != "off" && cfg.monitor != "edge" && cfg.monitor != "full")
+    {
+        NS_FATAL_ERROR("monitor precisa ser off, edge ou full.");
+    }
+    if (cfg.distributed && edge_monitor)
+    {
+        NS_FATAL_ERROR("monitor=edge nao funciona com distributed.");
+    }
+    if (cfg.bulkSetup && (cfg.flowStats || cfg.convergeTolerance > 0))
+    {
+        NS_FATAL_ERROR("flowStats e convergeTolerance nao funcionam com bulkSetup.");
+    }
+    if (cfg.bulkSetup && cfg.bulkPortBase + nFlows > 65536)
+    {
+        NS_FATAL_ERROR("bulkPortBase + nFlows passa da ultima porta.");
+    }
+    auto setupStart = std::chrono::steady_clock::now();
+    bool peakReset = ResetPeakResident();
+    uint64_t residentBefore = ResidentBytes();
     
     
     SeedManager::SetSeed(seed);
-    SeedManager::SetRun(1); 
+    SeedManager::SetRun(cfg.run);
 
     
     if (transport_prot.compare("TcpCubic") == 0){
@@ -352,8 +601,7 @@ main(int argc, char* argv[])
     } else if (transport_prot.compare("TcpNewReno") == 0){
         Config::SetDefault("ns3::TcpL4Protocol::SocketType", StringValue("ns3::TcpNewReno"));
     } else {
-        NS_LOG_ERROR("Protocolo de transporte inválido.");
-        return 1;
+        NS_FATAL_ERROR("Protocolo de transporte inválido.");
     }
 
     
@@ -364,10 +612,14 @@ main(int argc, char* argv[])
     uint32_t tcp_header = temp_header->GetSerializedSize();
     delete temp_header;
     uint32_t tcp_adu_size = mtu_bytes - 20 - (ip_header + tcp_header);
+    Config::SetDefault("ns3::TcpSocket::SegmentSize", UintegerValue(tcp_adu_size));
 
     
     NodeContainer nodes;
-    nodes.Create(5);
+    for (uint32_t partition : NODE_PARTITION)
+    {
+        nodes.Add(CreateObject<Node>(std::min(partition, ranks - 1)));
+    }
     Ptr<Node> fonte = nodes.Get(0);
     Ptr<Node> n1 = nodes.Get(1); 
     Ptr<Node> n2 = nodes.Get(2); 
@@ -387,15 +639,21 @@ main(int argc, char* argv[])
     NetDeviceContainer dev_s_n1 = p2p_fast.Install(link_s_n1);
 
     
-    Ptr<RateErrorModel> error_model = CreateObject<RateErrorModel>();
-    error_model->SetAttribute("ErrorRate", DoubleValue(errorRate));
-
     PointToPointHelper p2p_bottleneck;
     p2p_bottleneck.SetDeviceAttribute("DataRate", StringValue(dataRate));
     p2p_bottleneck.SetChannelAttribute("Delay", StringValue(delay));
-    p2p_bottleneck.SetDeviceAttribute("ReceiveErrorModel", PointerValue(error_model));
     
     NetDeviceContainer dev_n1_n2 = p2p_bottleneck.Install(link_n1_n2);
+
+    // Um modelo de erro por sentido do gargalo: cada um sorteia so os pacotes
+    // da sua ponta, e a sequencia e a mesma com ou sem particionamento MPI
+    std::array<Ptr<RateErrorModel>, 2> error_models;
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+        error_models[i] = CreateObject<RateErrorModel>();
+        error_models[i]->SetAttribute("ErrorRate", DoubleValue(errorRate));
+        dev_n1_n2.Get(i)->SetAttribute("ReceiveErrorModel", PointerValue(error_models[i]));
+    }
     
     
     NetDeviceContainer dev_n2_d1 = p2p_fast.Install(link_n2_d1);
@@ -407,8 +665,19 @@ main(int argc, char* argv[])
     NetDeviceContainer dev_n2_d2 = p2p_d2_slow.Install(link_n2_d2);
     
     
+    profiler.Mark("topology");
     InternetStackHelper stack;
     stack.Install(nodes);
+
+    // Streams fixos: o resultado nao depende de quantas execucoes vieram antes
+    // no mesmo processo (lote) nem de qual worker rodou o ponto
+    int64_t stream = cfg.streamBase;
+    for (Ptr<RateErrorModel> error_model : error_models)
+    {
+        stream += error_model->AssignStreams(stream);
+    }
+    stream += stack.AssignStreams(nodes, stream);
+    profiler.Mark("stack");
     
     Ipv4AddressHelper address;
 
@@ -424,115 +693,268 @@ main(int argc, char* argv[])
     address.SetBase("10.0.3.0", "255.255.255.0");
     Ipv4InterfaceContainer i_n2_d2 = address.Assign(dev_n2_d2);
 
+    profiler.Mark("addresses");
     Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+    profiler.Mark("routing");
 
     uint16_t port = 8080;
     
     ApplicationContainer sink_apps_dest1;
     ApplicationContainer sink_apps_dest2;
+    ApplicationContainer source_apps;
 
-    for (uint32_t i = 0; i < flows_per_dest; i++)
+    // Aplicacoes so nos nos deste rank (todos, sem MPI)
+    if (cfg.bulkSetup)
     {
-        Address serverAddress(InetSocketAddress(Ipv4Address::GetAny(), port + i));
-        PacketSinkHelper sink("ns3::TcpSocketFactory", serverAddress);
-        sink_apps_dest1.Add(sink.Install(dest1)); 
-    }
+        // Um sink por destino; o fluxo i sai da porta bulkPortBase + i e o
+        // RxWithAddresses do sink separa os bytes por fluxo
+        bulkFlows.portBase = cfg.bulkPortBase;
+        bulkFlows.rxBytes.assign(nFlows, 0);
+        PacketSinkHelper sink("ns3::TcpSocketFactory",
+                              InetSocketAddress(Ipv4Address::GetAny(), port));
+        if (dest1->GetSystemId() == rank)
+        {
+            sink_apps_dest1.Add(sink.Install(dest1));
+            sink_apps_dest1.Get(0)->TraceConnectWithoutContext("RxWithAddresses",
+                                                               MakeCallback(&BulkFlowRx));
+        }
+        if (dest2->GetSystemId() == rank)
+        {
+            sink_apps_dest2.Add(sink.Install(dest2));
+            sink_apps_dest2.Get(0)->TraceConnectWithoutContext("RxWithAddresses",
+                                                               MakeCallback(&BulkFlowRx));
+        }
 
-    for (uint32_t i = 0; i < flows_per_dest; i++)
-    {
-        Address serverAddress(InetSocketAddress(Ipv4Address::GetAny(), port + flows_per_dest + i));
-        PacketSinkHelper sink("ns3::TcpSocketFactory", serverAddress);
-        sink_apps_dest2.Add(sink.Install(dest2)); 
+        if (fonte->GetSystemId() == rank)
+        {
+            ObjectFactory ftp("ns3::BulkSendApplication");
+            ftp.Set("Protocol", TypeIdValue(TcpSocketFactory::GetTypeId()));
+            ftp.Set("SendSize", UintegerValue(tcp_adu_size));
+            ftp.Set("MaxBytes", UintegerValue(data_mbytes * 1000000));
+            Ipv4Address destAddress[2] = {i_n2_d1.GetAddress(1, 0), i_n2_d2.GetAddress(1, 0)};
+            for (uint32_t i = 0; i < nFlows; i++)
+            {
+                Ptr<Application> app = ftp.Create<Application>();
+                app->SetAttribute("Remote",
+                                  AddressValue(InetSocketAddress(destAddress[i >= flows_per_dest],
+                                                                 port)));
+                app->SetAttribute("Local",
+                                  AddressValue(InetSocketAddress(Ipv4Address::GetAny(),
+                                                                 cfg.bulkPortBase + i)));
+                fonte->AddApplication(app);
+                source_apps.Add(app);
+            }
+            source_apps.Start(Seconds(start_time));
+            source_apps.Stop(Seconds(stop_time));
+        }
     }
+    else
+    {
+        for (uint32_t i = 0; i < flows_per_dest && dest1->GetSystemId() == rank; i++)
+        {
+            Address serverAddress(InetSocketAddress(Ipv4Address::GetAny(), port + i));
+            PacketSinkHelper sink("ns3::TcpSocketFactory", serverAddress);
+            sink_apps_dest1.Add(sink.Install(dest1)); 
+        }
 
-    sink_apps_dest1.Start(Seconds(0.0));
-    sink_apps_dest1.Stop(Seconds(stop_time));
-    sink_apps_dest2.Start(Seconds(0.0));
-    sink_apps_dest2.Stop(Seconds(stop_time));
+        for (uint32_t i = 0; i < flows_per_dest && dest2->GetSystemId() == rank; i++)
+        {
+            Address serverAddress(InetSocketAddress(Ipv4Address::GetAny(), port + flows_per_dest + i));
+            PacketSinkHelper sink("ns3::TcpSocketFactory", serverAddress);
+            sink_apps_dest2.Add(sink.Install(dest2)); 
+        }
 
+        for (uint32_t i = 0; i < flows_per_dest && fonte->GetSystemId() == rank; i++)
+        {
+            AddressValue remoteAddress(InetSocketAddress(i_n2_d1.GetAddress(1, 0), port + i));
+            BulkSendHelper ftp("ns3::TcpSocketFactory", Address());
+            ftp.SetAttribute("Remote", remoteAddress);
+            ftp.SetAttribute("SendSize", UintegerValue(tcp_adu_size));
+            ftp.SetAttribute("MaxBytes", UintegerValue(data_mbytes * 1000000));
+
+            ApplicationContainer fonteApp = ftp.Install(fonte);
+            fonteApp.Start(Seconds(start_time)); 
+            fonteApp.Stop(Seconds(stop_time));
+            source_apps.Add(fonteApp);
+        }
 
-    Config::SetDefault("ns3::TcpSocket::SegmentSize", UintegerValue(tcp_adu_size));
     
-    for (uint32_t i = 0; i < flows_per_dest; i++)
-    {
-        AddressValue remoteAddress(InetSocketAddress(i_n2_d1.GetAddress(1, 0), port + i));
-        BulkSendHelper ftp("ns3::TcpSocketFactory", Address());
-        ftp.SetAttribute("Remote", remoteAddress);
-        ftp.SetAttribute("SendSize", UintegerValue(tcp_adu_size));
-        ftp.SetAttribute("MaxBytes", UintegerValue(data_mbytes * 1000000));
-
-        ApplicationContainer fonteApp = ftp.Install(fonte);
-        fonteApp.Start(Seconds(start_time)); 
-        fonteApp.Stop(Seconds(stop_time));
+        for (uint32_t i = 0; i < flows_per_dest && fonte->GetSystemId() == rank; i++)
+        {
+            AddressValue remoteAddress(InetSocketAddress(i_n2_d2.GetAddress(1, 0), port + flows_per_dest + i));
+            BulkSendHelper ftp("ns3::TcpSocketFactory", Address());
+            ftp.SetAttribute("Remote", remoteAddress);
+            ftp.SetAttribute("SendSize", UintegerValue(tcp_adu_size));
+            ftp.SetAttribute("MaxBytes", UintegerValue(data_mbytes * 1000000));
+
+            ApplicationContainer fonteApp = ftp.Install(fonte);
+            fonteApp.Start(Seconds(start_time)); 
+            fonteApp.Stop(Seconds(stop_time));
+            source_apps.Add(fonteApp);
+        }
     }
 
-    
-    for (uint32_t i = 0; i < flows_per_dest; i++)
-    {
-        AddressValue remoteAddress(InetSocketAddress(i_n2_d2.GetAddress(1, 0), port + flows_per_dest + i));
-        BulkSendHelper ftp("ns3::TcpSocketFactory", Address());
-        ftp.SetAttribute("Remote", remoteAddress);
-        ftp.SetAttribute("SendSize", UintegerValue(tcp_adu_size));
-        ftp.SetAttribute("MaxBytes", UintegerValue(data_mbytes * 1000000));
-
-        ApplicationContainer fonteApp = ftp.Install(fonte);
-        fonteApp.Start(Seconds(start_time)); 
-        fonteApp.Stop(Seconds(stop_time));
-    }
+    sink_apps_dest1.Start(Seconds(0.0));
+    sink_apps_dest1.Stop(Seconds(stop_time));
+    sink_apps_dest2.Start(Seconds(0.0));
+    sink_apps_dest2.Stop(Seconds(stop_time));
 
     
     if (tracing)
     {
-        firstCwnd[0] = true;
-        firstSshThr[0] = true;
-        firstRtt[0] = true;
-        firstRto[0] = true;
+        if (traceFormat == "binary")
+        {
+            binaryTrace.Open(prefix_file_name + "-tcp.bin", traceCompress, 65536);
+        }
+        else
+        {
+            AsciiTraceHelper tcpAscii;
+            tcpTrace = tcpAscii.CreateFileStream(prefix_file_name + "-tcp.data");
+        }
 
-        Simulator::Schedule(Seconds(start_time + 0.00001),
-                            &TraceCwnd,
-                            prefix_file_name + "-n0-cwnd.data",
-                            0, 0);
-        Simulator::Schedule(Seconds(start_time + 0.00001),
-                            &TraceRtt,
-                            prefix_file_name + "-n0-rtt.data",
-                            0, 0);
+        // Fluxos 0..flows_per_dest-1 vao para dest1, os demais para dest2
+        for (uint32_t i = 0; i < nFlows; i++)
+        {
+            Ptr<Application> sink = i < flows_per_dest ? sink_apps_dest1.Get(i)
+                                                       : sink_apps_dest2.Get(i - flows_per_dest);
+            TraceFlow(source_apps.Get(i), Seconds(start_time), sink);
+        }
     }
     
     
+    profiler.Mark("apps");
     FlowMonitorHelper flowHelper;
     if (flow_monitor)
     {
         flowHelper.Install(nodes);
     }
+    if (edge_monitor)
+    {
+        // Com bulkSetup todos os fluxos usam a porta 8080 do sink e se
+        // distinguem pela porta de origem
+        edgeMonitor.Start(NodeContainer(fonte),
+                          NodeContainer(dest1, dest2),
+                          cfg.bulkSetup ? cfg.bulkPortBase : port,
+                          nFlows,
+                          cfg.bulkSetup);
+    }
+    profiler.Mark("flowmonitor");
+
+    if (cfg.flowStats)
+    {
+        std::vector<Ptr<PacketSink>> sinks;
+        std::vector<uint8_t> rttClass;
+        for (uint32_t i = 0; i < nFlows; i++)
+        {
+            Ptr<Application> sink = i < flows_per_dest ? sink_apps_dest1.Get(i)
+                                                       : sink_apps_dest2.Get(i - flows_per_dest);
+            sinks.push_back(DynamicCast<PacketSink>(sink));
+            rttClass.push_back(i < flows_per_dest ? 0 : 1);
+        }
+        flowStats.Start(sinks,
+                        rttClass,
+                        Seconds(start_time),
+                        cfg.flowStatsBin,
+                        cfg.flowStatsBins,
+                        DataRate(dataRate).GetBitRate());
+    }
+
+    ConvergenceMonitor convergence;
+    if (cfg.convergeTolerance > 0)
+    {
+        std::vector<Ptr<PacketSink>> sinks;
+        for (uint32_t i = 0; i < nFlows; i++)
+        {
+            Ptr<Application> sink = i < flows_per_dest ? sink_apps_dest1.Get(i)
+                                                       : sink_apps_dest2.Get(i - flows_per_dest);
+            sinks.push_back(DynamicCast<PacketSink>(sink));
+        }
+        convergence.Start(sinks,
+                          Seconds(start_time) + cfg.convergeWarmup,
+                          cfg.convergeBatch,
+                          cfg.convergeTolerance,
+                          cfg.convergeMinBatches);
+    }
+
+    double setupSeconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - setupStart).count();
+    uint64_t residentSetup = ResidentBytes();
 
     Simulator::Stop(Seconds(stop_time));
+    auto runStart = std::chrono::steady_clock::now();
     Simulator::Run();
+    double runWallSeconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+    profiler.Mark("run");
+    FlushTraceReduction();
+    binaryTrace.Close();
+    traceTable.Clear();
+    tcpTrace = nullptr;
 
     
+    double simulatedSeconds = Simulator::Now().GetSeconds();
     double flowDuration = duration; 
-    uint64_t totalRxBytesDest1 = 0;
-    uint64_t totalRxBytesDest2 = 0;
-
-    
-    for (uint32_t i = 0; i < flows_per_dest; ++i)
+    if (convergence.IsEnabled())
     {
-        Ptr<Application> genericApp = sink_apps_dest1.Get(i);
-        Ptr<PacketSink> sinkApp = DynamicCast<PacketSink>(genericApp);
-        if (sinkApp)
+        convergence.Finish();
+        flowDuration = convergence.MeasuredSeconds();
+    }
+    if (flowStats.IsEnabled())
+    {
+        flowStats.Finish();
+    }
+    // Bytes recebidos por fluxo; no modo distribuido cada rank so conhece os
+    // seus sinks e o rank 0 soma os vetores de todos
+    std::vector<uint64_t> rxBytes(nFlows, 0);
+    for (uint32_t i = 0; i < nFlows; ++i)
+    {
+        Ptr<Node> destNode = i < flows_per_dest ? dest1 : dest2;
+        if (destNode->GetSystemId() != rank)
         {
-            totalRxBytesDest1 += sinkApp->GetTotalRx();
+            continue;
         }
+        // Com bulkSetup cada destino tem um unico sink
+        if (cfg.bulkSetup)
+        {
+            rxBytes[i] = bulkFlows.rxBytes[i];
+            continue;
+        }
+        Ptr<Application> sink = i < flows_per_dest ? sink_apps_dest1.Get(i)
+                                                   : sink_apps_dest2.Get(i - flows_per_dest);
+        rxBytes[i] = convergence.IsEnabled() ? convergence.RxBytes(i)
+                                             : DynamicCast<PacketSink>(sink)->GetTotalRx();
+    }
+    uint64_t events = Simulator::GetEventCount();
+#ifdef NS3_MPI
+    if (cfg.distributed)
+    {
+        std::vector<uint64_t> localRxBytes = rxBytes;
+        uint64_t localEvents = events;
+        MPI_Reduce(localRxBytes.data(),
+                   rxBytes.data(),
+                   nFlows,
+                   MPI_UINT64_T,
+                   MPI_SUM,
+                   0,
+                   MPI_COMM_WORLD);
+        MPI_Reduce(&localEvents, &events, 1, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
     }
+#endif
 
-    
-    for (uint32_t i = 0; i < flows_per_dest; ++i)
+    RunResult result;
+    if (rank != 0)
     {
-        Ptr<Application> genericApp = sink_apps_dest2.Get(i);
-        Ptr<PacketSink> sinkApp = DynamicCast<PacketSink>(genericApp);
-        if (sinkApp)
-        {
-            totalRxBytesDest2 += sinkApp->GetTotalRx();
-        }
+        Simulator::Destroy();
+        Ipv4AddressGenerator::Reset();
+        Config::Reset();
+        return result;
+    }
+
+    uint64_t totalRxBytesDest1 = 0;
+    uint64_t totalRxBytesDest2 = 0;
+    for (uint32_t i = 0; i < nFlows; ++i)
+    {
+        (i < flows_per_dest ? totalRxBytesDest1 : totalRxBytesDest2) += rxBytes[i];
     }
     
     double aggregateGoodputDest1 = (totalRxBytesDest1 * 8.0) / flowDuration;
@@ -543,6 +965,38 @@ main(int argc, char* argv[])
     
     double totalAggregateGoodput = aggregateGoodputDest1 + aggregateGoodputDest2;
 
+    result.aggregateGoodput = totalAggregateGoodput;
+    result.avgGoodputDest1 = avgGoodputDest1;
+    result.avgGoodputDest2 = avgGoodputDest2;
+    result.events = events;
+    result.setupSeconds = setupSeconds;
+    // Diferencas com sinal: o RSS pode encolher durante a execucao
+    result.setupBytesPerFlow = (double(residentSetup) - double(residentBefore)) / nFlows;
+    uint64_t residentPeak = PeakResidentBytes();
+    result.peakBytesPerFlow = peakReset && residentPeak > 0
+                                  ? (double(residentPeak) - double(residentBefore)) / nFlows
+                                  : std::numeric_limits<double>::quiet_NaN();
+    result.wallSeconds = runWallSeconds;
+    result.flowDuration = flowDuration;
+    result.simulatedSeconds = simulatedSeconds;
+    result.ranks = ranks;
+    if (flowStats.IsEnabled())
+    {
+        result.jain = flowStats.Jain();
+        result.meanBinJain = flowStats.MeanBinJain();
+        for (uint32_t i = 0; i < nFlows; ++i)
+        {
+            result.share.push_back(flowStats.Share(i));
+        }
+        result.rttImbalance = flowStats.ClassImbalance();
+    }
+    if (convergence.IsEnabled())
+    {
+        result.precision = convergence.Precision();
+        result.converged = convergence.Converged();
+    }
+    result.rxBytes = rxBytes;
+
     std::cout << "\n--- Resultados de Goodput (Parte 2) ---" << std::endl;
     std::cout << "Protocol: " << transport_prot << std::endl;
     std::cout << "Total Flows: " << nFlows << " (Flows/Dest: " << flows_per_dest << ")" << std::endl;
@@ -561,13 +1015,215 @@ main(int argc, char* argv[])
     
     std::cout << "------------------------------------------" << std::endl;
     std::cout << "Total Aggregate Goodput: " << totalAggregateGoodput << " bps" << std::endl;
+    if (flowStats.IsEnabled())
+    {
+        std::cout << "------------------------------------------" << std::endl;
+        for (uint32_t i = 0; i < nFlows; ++i)
+        {
+            std::cout << "Flow " << i + 1 << " (" << (i < flows_per_dest ? "Dest 1" : "Dest 2")
+                      << ") | Goodput: " << flowStats.Goodput(i)
+                      << " bps | Bottleneck Share: " << flowStats.Share(i) * 100 << "%"
+                      << std::endl;
+        }
+        std::cout << "Jain's Fairness Index: " << flowStats.Jain() << " (per-bin mean "
+                  << flowStats.MeanBinJain() << ", worst bin " << flowStats.MinBinJain() << ")"
+                  << std::endl;
+        std::cout << "RTT-Class Imbalance (Dest 1 / Dest 2 per-flow goodput): "
+                  << flowStats.ClassImbalance() << std::endl;
+        flowStats.WriteSeries(prefix_file_name + "-flowstats.data");
+    }
+    if (convergence.IsEnabled())
+    {
+        std::cout << "Convergence: " << (convergence.Converged() ? "reached" : "not reached")
+                  << " | precision " << convergence.Precision() << " (tolerance "
+                  << cfg.convergeTolerance << ") | " << convergence.Batches() << " batches | "
+                  << simulatedSeconds << " s simulated of " << stop_time << " s" << std::endl;
+    }
+    if (flow_monitor)
+    {
+        result.monitorBytesPerFlow = FlowMonitorBytesPerFlow(flowHelper.GetMonitor(), nFlows);
+        std::cout << "Flow monitor: " << result.monitorBytesPerFlow << " bytes/flow (edge would use "
+                  << EdgeMonitor::BytesPerFlow() << ", saving "
+                  << result.monitorBytesPerFlow - EdgeMonitor::BytesPerFlow() << " bytes/flow)"
+                  << std::endl;
+    }
+    if (edgeMonitor.IsEnabled())
+    {
+        uint64_t lost = 0;
+        int64_t delayMax = 0;
+        for (const EdgeFlowCounters& c : edgeMonitor.Flows())
+        {
+            lost += c.txPackets - std::min(c.rxPackets, c.txPackets);
+            delayMax = std::max(delayMax, c.delayMax);
+        }
+        result.monitorBytesPerFlow = EdgeMonitor::BytesPerFlow();
+        std::cout << "Edge monitor: " << result.monitorBytesPerFlow << " bytes/flow | " << lost
+                  << " packets lost | max delay " << delayMax * 1e-6 << " ms" << std::endl;
+        edgeMonitor.WriteCsv(prefix_file_name + "-flows.csv");
+    }
+    std::cout << "Setup: " << setupSeconds << " s | " << result.setupBytesPerFlow
+              << " bytes/flow after setup | " << result.peakBytesPerFlow
+              << " bytes/flow at peak" << std::endl;
+    std::cout << "Events executed: " << events << " (" << events / runWallSeconds << " events/s)"
+              << std::endl;
+    if (cfg.distributed)
+    {
+        std::cout << "Ranks: " << ranks << std::endl;
+    }
 
 
+    profiler.Mark("results");
     if (flow_monitor)
     {
         flowHelper.SerializeToXmlFile(prefix_file_name + ".flowmonitor", true, true);
     }
+    profiler.Mark("serialize");
 
+    // Desmonta tudo para que a proxima execucao do lote comece do zero
+    bulkFlows = BulkFlowTable();
+    flowStats = FlowStats();
+    edgeMonitor = EdgeMonitor();
     Simulator::Destroy();
+    Ipv4AddressGenerator::Reset();
+    Config::Reset();
+    profiler.Mark("teardown");
+
+    result.phases = profiler.Phases();
+    profiler.Report(std::cout, simulatedSeconds, result.events);
+    if (resultWriter.IsOpen())
+    {
+        resultWriter.WriteRecord(FormatResult(cfg, prefix_file_name, result));
+    }
+    return result;
+}
+
+/**
+ * Run every configuration of a parameter file in this process.
+ *
+ * Each non-empty line holds command-line options (with or without the leading
+ * "--") on top of the defaults, plus an optional seeds=a,b,c list of
+ * replications. Every run is written as a "run" record and every line as an
+ * "agg" record with the mean, standard deviation and 95% confidence interval
+ * over its replications.
+ *
+ * @param defaults Configuration the lines start from.
+ * @param batchFile Parameter file.
+ * @param batchOutput CSV output file.
+ */
+static void
+RunBatch(const SimConfig& defaults, const std::string& batchFile, const std::string& batchOutput)
+{
+    std::ifstream in(batchFile);
+    if (!in)
+    {
+        NS_FATAL_ERROR("Nao foi possivel abrir o arquivo de lote " << batchFile);
+    }
+    std::ofstream out(batchOutput);
+    if (!out)
+    {
+        NS_FATAL_ERROR("Nao foi possivel criar a saida do lote " << batchOutput);
+    }
+    out.precision(12);
+    out << BATCH_HEADER << std::endl;
+
+    std::string line;
+    uint32_t lineNo = 0;
+    while (std::getline(in, line))
+    {
+        lineNo++;
+        std::istringstream tokens(line);
+        std::vector<std::string> args{batchFile};
+        std::string token;
+        while (tokens >> token)
+        {
+            args.push_back(token.rfind("-", 0) == 0 ? token : "--" + token);
+        }
+        if (args.size() == 1 || args[1].rfind("--#", 0) == 0)
+        {
+            continue;
+        }
+
+        SimConfig cfg = defaults;
+        std::string seeds;
+        CommandLine lineCmd;
+        AddConfigValues(lineCmd, cfg);
+        lineCmd.AddValue("seeds", "Comma-separated seeds, one replication each", seeds);
+        lineCmd.Parse(args);
+
+        std::vector<uint32_t> seedList = seeds.empty() ? std::vector<uint32_t>{cfg.seed}
+                                                       : ParseSeeds(seeds);
+        BatchSamples samples;
+        for (uint32_t seed : seedList)
+        {
+            cfg.seed = seed;
+            std::string base = cfg.prefix.empty() ? "lab2-part2-" + cfg.transport_prot : cfg.prefix;
+            std::string prefix = base + "-b" + std::to_string(lineNo) + "-s" +
+                                 std::to_string(seed);
+            RunResult result = RunSimulation(cfg, prefix);
+            WriteBatchRun(out, lineNo, cfg, result);
+            samples.Add(result);
+        }
+        WriteBatchSummary(out, lineNo, cfg, samples);
+    }
+}
+
+int
+main(int argc, char* argv[])
+{
+    SimConfig cfg;
+    std::string batchFile;
+    std::string batchOutput;
+    std::string resultFile;
+
+    CommandLine cmd(__FILE__);
+    AddConfigValues(cmd, cfg);
+    cmd.AddValue("batchFile",
+                 "Parameter file with one configuration (and seeds=a,b,c) per line; "
+                 "runs them all in this process",
+                 batchFile);
+    cmd.AddValue("batchOutput", "CSV file for the batch records", batchOutput);
+    cmd.AddValue("resultFile",
+                 "JSON result record of every run, one per line: file name, - (stdout) or fd:N",
+                 resultFile);
+    cmd.Parse(argc, argv);
+
+    if (cfg.distributed)
+    {
+#ifdef NS3_MPI
+        if (!batchFile.empty())
+        {
+            NS_FATAL_ERROR("batchFile nao funciona com distributed.");
+        }
+        GlobalValue::Bind("SimulatorImplementationType",
+                          StringValue("ns3::DistributedSimulatorImpl"));
+        MpiInterface::Enable(&argc, &argv);
+#else
+        NS_FATAL_ERROR("distributed precisa do ns-3 compilado com MPI (./ns3 configure --enable-mpi).");
+#endif
+    }
+
+    if (!resultFile.empty() && LocalRank(cfg) == 0)
+    {
+        resultWriter.Open(resultFile);
+    }
+
+    if (batchFile.empty())
+    {
+        std::string prefix = cfg.prefix.empty() ? "lab2-part2-" + cfg.transport_prot + "-" +
+                                                      std::to_string(cfg.nFlows)
+                                                : cfg.prefix;
+        RunSimulation(cfg, prefix);
+    }
+    else
+    {
+        RunBatch(cfg, batchFile, batchOutput.empty() ? batchFile + ".csv" : batchOutput);
+    }
+    resultWriter.Close();
+#ifdef NS3_MPI
+    if (cfg.distributed)
+    {
+        MpiInterface::Disable();
+    }
+#endif
     return 0;
-}
\ No newline at end of file
+}